@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Throughput benchmark for generated dumpers.
+//
+// Built once per schema, with BENCH_INPUT naming the input header and
+// BENCH_OUT the generated code (see the bench targets in the Makefile). Every
+// generated struct is dumped, zero-filled and filled with random bytes (with
+// the _Bool members fixed up to 0 or 1), to /dev/null and the results are
+// written as JSON.
+//
+// Allocations are counted by linking with -Wl,--wrap=malloc,--wrap=calloc,
+// --wrap=realloc, so only allocations made outside of libc are seen.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "json_types.h"
+#include BENCH_INPUT
+#include BENCH_OUT
+
+#ifndef BENCH_SCHEMA
+#define BENCH_SCHEMA "unknown"
+#endif
+
+#ifndef BENCH_OPT
+#define BENCH_OPT "unknown"
+#endif
+
+static uint64_t g_num_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    g_num_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    g_num_allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    g_num_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+struct bench_result {
+    uint64_t iterations;
+    uint64_t bytes;
+    double ns_per_struct;
+    double mb_per_s;
+    double allocs_per_struct;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// xorshift64, so that the random instances are the same on every run
+static uint64_t g_rand_state = 0x9e3779b97f4a7c15ull;
+
+static void fill_random(uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        g_rand_state ^= g_rand_state << 13;
+        g_rand_state ^= g_rand_state >> 7;
+        g_rand_state ^= g_rand_state << 17;
+        p[i] = (uint8_t) g_rand_state;
+    }
+}
+
+// Number of bytes a single dump of p produces. The first dump may start at
+// column 0 and get indented, so the second one is measured, like the dumps in
+// the timed loop.
+static uint64_t measure_bytes(const struct json_type_info *t, void *p)
+{
+    char path[] = "/tmp/bench_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    FILE *f = freopen(path, "w", stdout);
+    assert(f);
+    t->dump(1, p);
+    fflush(stdout);
+    long start = ftell(stdout);
+    t->dump(1, p);
+    fflush(stdout);
+    long len = ftell(stdout) - start;
+    assert(start >= 0 && len >= 0);
+
+    f = freopen("/dev/null", "w", stdout);
+    assert(f);
+    unlink(path);
+
+    return (uint64_t) len;
+}
+
+static void run_one(const struct json_type_info *t, void *p, uint64_t iterations, double min_seconds, struct bench_result *r)
+{
+    uint64_t bytes = measure_bytes(t, p);
+    uint64_t done = 0;
+    uint64_t allocs_start = g_num_allocs;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+
+    // Run at least the requested number of iterations, and for at least
+    // min_seconds.
+    do {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            t->dump(1, p);
+        }
+        done += iterations;
+        elapsed = now_ns() - start;
+    } while (elapsed < min_seconds * 1e9);
+    fflush(stdout);
+    elapsed = now_ns() - start;
+
+    r->iterations = done;
+    r->bytes = bytes;
+    r->ns_per_struct = (double) elapsed / done;
+    r->mb_per_s = (double) bytes * done / (elapsed / 1e9) / 1e6;
+    r->allocs_per_struct = (double) (g_num_allocs - allocs_start) / done;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [-t min_seconds] [-o results.json]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = 1000;
+    double min_seconds = 0.1;
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            min_seconds = strtod(optarg, NULL);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (iterations == 0) {
+        usage(argv[0]);
+    }
+
+    FILE *out = stderr;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    static const char *const fills[] = { "zero", "random" };
+    uint64_t total_ns = 0, total_bytes = 0, total_structs = 0, total_allocs = 0;
+
+    fprintf(out, "{\n");
+    fprintf(out, "    \"schema\": \"%s\",\n", BENCH_SCHEMA);
+    fprintf(out, "    \"opt\": \"%s\",\n", BENCH_OPT);
+    fprintf(out, "    \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(out, "    \"results\": [\n");
+
+    for (size_t i = 0; i < json_num_types; ++i) {
+        const struct json_type_info *t = &json_types[i];
+        // Never allocate zero bytes for empty structs
+        uint8_t *p = calloc(1, t->size + 1);
+        assert(p);
+
+        for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); ++f) {
+            struct bench_result r;
+
+            if (f == 1) {
+                fill_random(p, t->size);
+                if (t->fix) {
+                    t->fix(p);
+                }
+            }
+
+            run_one(t, p, iterations, min_seconds, &r);
+
+            total_ns += (uint64_t) (r.ns_per_struct * r.iterations);
+            total_bytes += r.bytes * r.iterations;
+            total_structs += r.iterations;
+            total_allocs += (uint64_t) (r.allocs_per_struct * r.iterations + 0.5);
+
+            fprintf(out, "        { \"type\": \"%s\", \"fill\": \"%s\", \"size\": %zu, \"iterations\": %" PRIu64
+                ", \"bytes_per_struct\": %" PRIu64 ", \"ns_per_struct\": %.1f, \"mb_per_s\": %.2f"
+                ", \"allocs_per_struct\": %.2f }%s\n",
+                t->name, fills[f], t->size, r.iterations, r.bytes, r.ns_per_struct, r.mb_per_s,
+                r.allocs_per_struct, (i + 1 == json_num_types && f == 1) ? "" : ",");
+        }
+
+        free(p);
+    }
+
+    fprintf(out, "    ],\n");
+    fprintf(out, "    \"total\": { \"structs\": %" PRIu64 ", \"ns_per_struct\": %.1f, \"mb_per_s\": %.2f"
+        ", \"allocs_per_struct\": %.2f }\n",
+        total_structs, total_structs ? (double) total_ns / total_structs : 0.0,
+        total_ns ? (double) total_bytes / (total_ns / 1e9) / 1e6 : 0.0,
+        total_structs ? (double) total_allocs / total_structs : 0.0);
+    fprintf(out, "}\n");
+
+    if (out != stderr) {
+        fclose(out);
+    }
+
+    return 0;
+}
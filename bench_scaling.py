@@ -0,0 +1,137 @@
+#!/bin/env python3
+#
+# Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+#
+# Permission to use, copy, modify, and distribute this software for
+# any purpose with or without fee is hereby granted, provided that
+# the above copyright notice and this permission notice appear in all
+# copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+# DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+# OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+# TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Scaling benchmark: sweep one gen_header.py parameter at a time and record,
+# for every synthesized header, the generator wall time and peak memory, the
+# compile time of the generated code and the dump throughput of bench.c.
+#
+# Results are written as one JSON object per line.
+
+import os
+import sys
+import json
+import time
+import argparse
+import tempfile
+import subprocess
+
+import gen_header
+
+repo_dir = os.path.dirname(os.path.abspath(__file__))
+
+# Parameter sweeps, each run with all other parameters at their defaults
+sweeps = {
+    "structs": [10, 100, 1000],
+    "fields": [4, 16, 64],
+    "depth": [0, 1, 2, 3],
+    "array_rank": [0, 1, 2, 3, 4],
+    "array_dim": [2, 8, 32],
+    "anon_ratio": [0.0, 0.5, 1.0],
+    "enum_values": [4, 64, 1024],
+}
+
+quick_sweeps = {
+    "structs": [10, 100],
+    "array_rank": [0, 2, 4],
+}
+
+# Run a command, returning its wall time in seconds and peak RSS in KiB
+def run_measured(cmd, **kwargs):
+    start = time.monotonic()
+    p = subprocess.Popen(cmd, **kwargs)
+    _, status, rusage = os.wait4(p.pid, 0)
+    elapsed = time.monotonic() - start
+    p.returncode = os.waitstatus_to_exitcode(status)
+
+    if p.returncode != 0:
+        raise RuntimeError("command failed ({}): {}".format(p.returncode, " ".join(cmd)))
+
+    return elapsed, rusage.ru_maxrss
+
+def run_point(args, params, work_dir):
+    hdr = os.path.join(work_dir, "gen_input.h")
+    pre = os.path.join(work_dir, "gen_input.i")
+    out = os.path.join(work_dir, "gen_out.c")
+    exe = os.path.join(work_dir, "bench_gen")
+    res = os.path.join(work_dir, "bench_gen.json")
+
+    text = gen_header.HeaderGen(params).generate()
+    with open(hdr, "w") as f:
+        f.write(text)
+
+    subprocess.run([args.cc, "-E", hdr, "-o", pre], check=True)
+
+    with open(out, "w") as f_out, open(os.devnull, "w") as f_err:
+        gen_time, gen_rss = run_measured([sys.executable, os.path.join(repo_dir, "c_header_to_json.py"), pre], stdout=f_out, stderr=f_err)
+
+    compile_time, compile_rss = run_measured([args.cc, "-O2", "-DJSON_TYPE_TABLE", "-I", repo_dir,
+        '-DBENCH_INPUT="{}"'.format(hdr), '-DBENCH_OUT="{}"'.format(out),
+        os.path.join(repo_dir, "bench.c"), os.path.join(repo_dir, "util.c"),
+        "-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc", "-o", exe])
+
+    subprocess.run([exe, "-n", str(args.iterations), "-t", "0", "-o", res], check=True)
+    with open(res) as f:
+        total = json.load(f)["total"]
+
+    return {
+        "header_bytes": len(text),
+        "generated_bytes": os.path.getsize(out),
+        "generator_s": round(gen_time, 3),
+        "generator_max_rss_kib": gen_rss,
+        "compile_s": round(compile_time, 3),
+        "compile_max_rss_kib": compile_rss,
+        "dump_ns_per_struct": total["ns_per_struct"],
+        "dump_mb_per_s": total["mb_per_s"],
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description="Scaling benchmark of the generator and generated code")
+    gen_header.add_arguments(parser)
+    parser.add_argument("--sweep", action="append", help="only run the named sweep(s), e.g. structs")
+    parser.add_argument("--quick", action="store_true", help="run a small subset of the sweeps")
+    parser.add_argument("--iterations", type=int, default=100, help="dumps per struct in the throughput run")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="C compiler")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    to_run = quick_sweeps if args.quick else sweeps
+    if args.sweep:
+        unknown = [s for s in args.sweep if s not in sweeps]
+        if unknown:
+            parser.error("unknown sweep(s): {}".format(", ".join(unknown)))
+        to_run = {s: sweeps[s] for s in args.sweep}
+
+    out = open(args.output, "w") if args.output else sys.stdout
+
+    with tempfile.TemporaryDirectory(prefix="bench_scaling_") as work_dir:
+        for param, values in to_run.items():
+            for value in values:
+                params = argparse.Namespace(**vars(args))
+                setattr(params, param, value)
+
+                r = {"sweep": param, "value": value}
+                r.update(run_point(args, params, work_dir))
+                out.write(json.dumps(r) + "\n")
+                out.flush()
+
+    if out is not sys.stdout:
+        out.close()
+
+if __name__ == '__main__':
+    main()
@@ -17,25 +17,56 @@
 # PERFORMANCE OF THIS SOFTWARE.
 #
 
+import os
 import sys
+import json
+import hashlib
+import argparse
 import pycparser
 import pprint
 import re
+import subprocess
 
 c_indent_level = 0
 json_indent_level = 0
 
-import sys
+# Debug tracing to stderr, enabled with --debug
+debug = False
+
+# Generated code is collected here and written out once at the end
+out_lines = []
+
+# While generating the implementation shared by structs of the same shape
+# (see generate_c_shared_struct_functions()), the struct type whose layout is
+# used to access members, and the JSON keys in the order they are printed.
+shared_type = None
+shared_keys = None
+
+# Byte order ("little" or "big") of the members of the struct being generated,
+# None for host byte order.
+load_byte_order = None
+
+# Type of the struct being generated when its dumper may get a pointer at any
+# alignment, in which case members are located with offsetof() and loaded
+# with memcpy() instead of through s->.
+load_unaligned_type = None
 
 def eprint(*args, **kwargs):
     print(*args, file=sys.stderr, **kwargs)
 
+def dprint(*args, **kwargs):
+    if debug:
+        eprint(*args, **kwargs)
+
+def emit(line):
+    out_lines.append(line)
+
 def type_is_enum(item_type, items):
-    eprint("enter type_is_enum, looking for {}".format(item_type))
+    dprint("enter type_is_enum, looking for {}".format(item_type))
     for item in items:
-        eprint(item["name"])
+        dprint(item["name"])
         if item["type"] == item_type:
-            eprint("found: {}".format(item))
+            dprint("found: {}".format(item))
             assert(0)
             return True
 
@@ -52,10 +83,76 @@ type_to_fmt_str = {
     "long long": "%lld",
     "long": "%ld",
     "_Bool": "%d",
+    "float": "%s",
+    "double": "%s",
 }
 
-def fmt_type_is_string(type_str):
-    return type_str in ("char",)
+# Floating point members are printed as strings formatted by the runtime
+float_format_macros = {
+    "float": "JSON_FORMAT_FLOAT",
+    "double": "JSON_FORMAT_DOUBLE",
+}
+
+# Returns the format string fragment and the printf argument (or None)
+# printing the JSON key name. Shared implementations take their keys from a
+# name table.
+def json_key(name):
+    if shared_type is None:
+        return name, None
+
+    shared_keys.append(name)
+    return "%s", "names[{}]".format(len(shared_keys) - 1)
+
+# Formats the printf arguments following the format string, skipping None
+def c_args(*args):
+    return "".join(", " + a for a in args if a is not None)
+
+# Returns the C expression for a struct member. var_path is the path of the
+# enclosing (untagged) structs, e.g. "s->" or "s->inner.".
+def member_expr(var_path, name, suffix):
+    struct_type = shared_type or load_unaligned_type
+    if struct_type is None:
+        return "{}{}{}".format(var_path, name, suffix)
+
+    return "JSON_MEMBER({}, s, {}{}){}".format(struct_type, var_path[len("s->"):], name, suffix)
+
+# Expression loading the value of scalar member c
+def member_load(c, var_path, suffix):
+    if c["type"] in float_format_macros and type_needs_byte_swap(c):
+        # loaded from its address as an integer and swapped before it is a
+        # floating point value, which could change a swapped signaling NaN
+        return "JSON_LOAD_{}_{}(&{})".format("LE" if load_byte_order == "little" else "BE", c["type"].upper(),
+            member_expr(var_path, c["name"], suffix))
+
+    if load_unaligned_type is None or c["type"] in single_byte_types:
+        return member_expr(var_path, c["name"], suffix)
+
+    if "bit_size" in c:
+        # bit-fields can not be located with offsetof(), the compiler knows
+        # their alignment
+        return "{}{}{}".format(var_path, c["name"], suffix)
+
+    return "JSON_LOAD_UNALIGNED({}, s, {}{}{})".format(shared_type or load_unaligned_type, var_path[len("s->"):], c["name"], suffix)
+
+# Single byte types never need byte order conversion
+single_byte_types = ("char", "_Bool", "int8_t", "uint8_t")
+
+def type_needs_byte_swap(c):
+    if load_byte_order is None or "bit_size" in c or c["type"] in single_byte_types:
+        return False
+
+    return c["type"] in type_to_fmt_str or stdint_type_re.match(c["type"]) is not None or c["type"].startswith("enum ")
+
+# Returns expr, the value of scalar member c, converted to host byte order
+def load_expr(c, expr):
+    if not type_needs_byte_swap(c):
+        return expr
+
+    if c["type"] in float_format_macros:
+        # converted by member_load()
+        return expr
+
+    return "JSON_LOAD_{}({})".format("LE" if load_byte_order == "little" else "BE", expr)
 
 # which_dim is which dimension is being queried (multi_dim[0][1][2][3] <-- the
 # value shown here is which_dim)
@@ -88,6 +185,73 @@ def get_array_bounds_string(arr_info, which_dim):
     else:
         assert(0)
 
+def paren_dim(dim):
+    return dim if dim.isdigit() else "({})".format(dim)
+
+# Product of array dimensions as a C constant expression
+def dims_product(dims):
+    if all(d.isdigit() for d in dims):
+        n = 1
+        for d in dims:
+            n *= int(d)
+        return str(n)
+
+    return " * ".join(paren_dim(d) for d in dims)
+
+# Emit the separator printed before element var (if not the first) of a
+# multi-dimensional array flattened over dims: when var is a multiple of the
+# stride of a dimension, the brackets of the dimensions inside it are closed
+# and opened again. The innermost dimension gets default. Elements that are
+# rows of the array close inner_closes more brackets.
+def emit_flat_separators(var, dims, default, inner_closes):
+    global c_indent_level
+
+    depth = len(dims)
+    emit("{}if ({} != 0) {{".format("    " * c_indent_level, var))
+    c_indent_level += 1
+    keyword = "if"
+    for idx in range(depth - 1):
+        closes = depth - 1 - idx + inner_closes - 1
+        emit("{}{} ({} % {} == 0) {{".format("    " * c_indent_level, keyword, var, paren_dim(dims_product(dims[idx + 1:]))))
+        emit(r'{}    i_printf(indent_level + {}, "{},\n{}");'.format("    " * c_indent_level, json_indent_level, "]" * closes, "[" * closes))
+        keyword = "} else if"
+    if keyword == "if":
+        emit(r'{}i_printf(indent_level + {}, "{}");'.format("    " * c_indent_level, json_indent_level, default))
+    else:
+        emit("{}}} else {{".format("    " * c_indent_level))
+        emit(r'{}    i_printf(indent_level + {}, "{}");'.format("    " * c_indent_level, json_indent_level, default))
+        emit("{}}}".format("    " * c_indent_level))
+    c_indent_level -= 1
+    emit("{}}}".format("    " * c_indent_level))
+
+# Arguments of json_print_int_array() after the length, the width and
+# signedness of the integer elements of array c, or None for other types
+def int_array_width(c):
+    t = c["type"]
+    m = stdint_type_re.fullmatch(t)
+    if m:
+        return "{}, {}".format(int(m.group(2)) // 8, "false" if m.group(1) else "true")
+    if t in type_to_fmt_str and t not in ("char", "float", "double"):
+        return "sizeof({}), {}".format(t, "false" if t.startswith("unsigned") or t == "_Bool" else "true")
+
+    return None
+
+# Function printing integer array c, byte swapping the elements of arrays in
+# the other byte order as they are formatted
+def int_array_print_function(c):
+    if type_needs_byte_swap(c):
+        return "JSON_PRINT_INT_ARRAY_{}".format("LE" if load_byte_order == "little" else "BE")
+
+    return "json_print_int_array"
+
+# Flexible array members and struct definitions without a declarator are not
+# printed
+def child_is_skipped(c):
+    if "array_len" in c and len(c["array_len"]) == 1 and c["array_len"][0] is None:
+        return True
+
+    return c["name"] is None and c["type"].startswith("struct ") and c["type"] != "struct "
+
 def generate_c_json_for_children(item, info, var_path, print_braces=True, always_print_comma=False):
     global c_indent_level, json_indent_level
 
@@ -96,7 +260,8 @@ def generate_c_json_for_children(item, info, var_path, print_braces=True, always
         print_name = item["type"].split("struct ")[1]
         if print_name == "":
             print_name = item["name"]
-        print(r'{}i_printf(indent_level + {}, "\"{}\": {{\n");'.format("    " * c_indent_level, json_indent_level, print_name))
+        key, key_arg = json_key(print_name)
+        emit(r'{}i_printf(indent_level + {}, "\"{}\": {{\n"{});'.format("    " * c_indent_level, json_indent_level, key, c_args(key_arg)))
         json_indent_level += 1
 
     num_children = len(item["children"])
@@ -105,10 +270,14 @@ def generate_c_json_for_children(item, info, var_path, print_braces=True, always
         # TODO: we assume the struct argument is s... which is true for now.
         # Avoid compilation warning for unused argument in cases where the
         # structure is empty (no children)
-        print(r'{}(void) s;'.format("    " * c_indent_level))
+        emit(r'{}(void) s;'.format("    " * c_indent_level))
+
+    # members that are skipped must not get a comma printed before them
+    printed = [c_idx for c_idx, c in enumerate(item["children"]) if not child_is_skipped(c)]
+    last_printed = printed[-1] if printed else -1
 
     for c_idx, c in enumerate(item["children"]):
-        final_item = (c_idx + 1 >= num_children)
+        final_item = (c_idx >= last_printed)
 
         if always_print_comma or not final_item:
             line_end = ","
@@ -118,44 +287,76 @@ def generate_c_json_for_children(item, info, var_path, print_braces=True, always
         # handle array case
         array_depth = 0
         array_suffix = ""
+        string_len = None
+        flat_array = False
         if "array_len" in c:
             array_len = c["array_len"]
+            if c["type"] == "char" and None not in array_len:
+                # the innermost dimension of a char array is a string
+                string_len = array_len[-1]
+                array_len = array_len[:-1]
             array_depth = len(array_len)
-            if len(array_len) > 1:
+            if len(array_len) > 1 and int_array_width(c) and string_len is None:
+                # one bulk formatted row of the innermost dimension at a time
+                rows = dims_product(array_len[:-1])
+                array_expr = member_expr(var_path, c["name"], "")
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": {}"{});'.format("    " * c_indent_level, json_indent_level, key, "[" * array_depth, c_args(key_arg)))
+                emit("{}for (int r = 0; r < {}; ++r) {{".format("    " * c_indent_level, rows))
+                c_indent_level += 1
+                emit_flat_separators("r", array_len[:-1], r"],\n[", 2)
+                emit("{}{}((const char *) &{} + r * (sizeof({}) / {}), {}, {});".format("    " * c_indent_level, int_array_print_function(c),
+                    array_expr, array_expr, rows if rows.isdigit() else "(" + rows + ")", array_len[-1], int_array_width(c)))
+                c_indent_level -= 1
+                emit("{}}}".format("    " * c_indent_level))
+                emit(r'{}i_printf(indent_level + {}, "{}{}\n");'.format("    " * c_indent_level, json_indent_level, "]" * array_depth, line_end))
+                continue
+            elif len(array_len) > 1:
+                # a single loop over all elements, the indices are derived
+                # from the flat index
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": {}"{});'.format("    " * c_indent_level, json_indent_level, key, "[" * array_depth, c_args(key_arg)))
+                emit("{}for (int i = 0; i < {}; ++i) {{".format("    " * c_indent_level, dims_product(array_len)))
+                c_indent_level += 1
+                emit_flat_separators("i", array_len, ", ", 1)
                 array_suffix = ""
-                print(r'{}i_printf(indent_level + {}, "\"{}\": ");'.format("    " * c_indent_level, json_indent_level, c["name"]))
                 for idx in range(array_depth):
-                    var_name = "a{}".format(idx)
-                    array_suffix += "[{}]".format(var_name)
-
-                    dim_str = get_array_bounds_string(array_len, idx)
-                    print(r'{}i_printf(indent_level + {}, "[");'.format("    " * c_indent_level, json_indent_level))
-                    print("{0}for (int {1} = 0; {1} < {2}; ++{1}) {{".format("    " * c_indent_level, var_name, dim_str))
-                    c_indent_level += 1
-                    print(r'{}if ({} != 0) {{'.format("    " * c_indent_level, var_name))
-                    c_indent_level += 1
-                    if idx + 1 == array_depth:
-                        print(r'{}i_printf(indent_level + {}, ", ");'.format("    " * c_indent_level, json_indent_level))
+                    stride = dims_product(array_len[idx + 1:])
+                    if idx == 0:
+                        index = "i / {}".format(stride)
+                    elif idx + 1 == array_depth:
+                        index = "i % {}".format(paren_dim(array_len[idx]))
                     else:
-                        print(r'{}i_printf(indent_level + {}, ",\n");'.format("    " * c_indent_level, json_indent_level))
-                    c_indent_level -= 1
-                    print(r'{}}}'.format("    " * c_indent_level))
+                        index = "i / {} % {}".format(paren_dim(stride), paren_dim(array_len[idx]))
+                    emit("{}int a{} = {};".format("    " * c_indent_level, idx, index))
+                    array_suffix += "[a{}]".format(idx)
+                flat_array = True
+            elif not array_len:
+                pass
             elif array_len[0] is None:
-                print("{}// skipped variable length array named {} of type {}".format("    " * c_indent_level, c["name"], c["type"]))
+                emit("{}// skipped variable length array named {} of type {}".format("    " * c_indent_level, c["name"], c["type"]))
+                continue
+            elif int_array_width(c) and string_len is None:
+                array_expr = member_expr(var_path, c["name"], "")
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": ["{});'.format("    " * c_indent_level, json_indent_level, key, c_args(key_arg)))
+                emit("{}{}(&{}, {}, {});".format("    " * c_indent_level, int_array_print_function(c), array_expr, array_len[0], int_array_width(c)))
+                emit(r'{}i_printf(indent_level + {}, "]{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
                 continue
             else:
-                dim_str = get_array_bounds_string(array_len, 0)
+                dim_str = array_len[0]
                 var_name = "i"
                 array_suffix = "[{}]".format(var_name)
-                print(r'{}i_printf(indent_level + {}, "\"{}\": [");'.format("    " * c_indent_level, json_indent_level, c["name"]))
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": ["{});'.format("    " * c_indent_level, json_indent_level, key, c_args(key_arg)))
                 #json_indent_level += 1
-                print("{}for (int i = 0; i < {}; ++i) {{".format("    " * c_indent_level, dim_str))
+                emit("{}for (int i = 0; i < {}; ++i) {{".format("    " * c_indent_level, dim_str))
                 c_indent_level += 1
-                print(r'{}if ({} != 0) {{'.format("    " * c_indent_level, var_name))
+                emit(r'{}if ({} != 0) {{'.format("    " * c_indent_level, var_name))
                 c_indent_level += 1
-                print(r'{}i_printf(indent_level + {}, ", ");'.format("    " * c_indent_level, json_indent_level))
+                emit(r'{}i_printf(indent_level + {}, ", ");'.format("    " * c_indent_level, json_indent_level))
                 c_indent_level -= 1
-                print(r'{}}}'.format("    " * c_indent_level))
+                emit(r'{}}}'.format("    " * c_indent_level))
 
         printf_var_str = None
         printf_var_is_string = True
@@ -174,65 +375,108 @@ def generate_c_json_for_children(item, info, var_path, print_braces=True, always
                     generate_c_json_for_children(c, info, var_path, print_braces=False, always_print_comma=not final_item)
                 else:
                     # definition of a struct, but one is not declared
-                    print("{}// skipped definition without declaration (type: {})".format("    " * c_indent_level, c["type"]))
+                    emit("{}// skipped definition without declaration (type: {})".format("    " * c_indent_level, c["type"]))
             elif c["type"] == "struct ":
                 # not-anonymous but untagged struct since it is not tagged we
                 # can't create a function to call, but we can print it out with
                 # the name prefix.
                 generate_c_json_for_children(c, info, var_path + c["name"] + ".")
-                print(r'{}i_printf(indent_level + {}, "{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
+                emit(r'{}i_printf(indent_level + {}, "{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
             else:
                 # sub-struct has associated type, call function to print it
-                print(r'{}dump_json_struct_{}(indent_level + {}, &{}{}{});'.format("    " * c_indent_level, c["type"].split("struct ")[1], json_indent_level, var_path, c["name"], array_suffix))
-                print(r'{}i_printf(indent_level + {}, "{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
+                emit(r'{}dump_json_struct_{}(indent_level + {}, &{});'.format("    " * c_indent_level, c["type"].split("struct ")[1], json_indent_level, member_expr(var_path, c["name"], array_suffix)))
+                emit(r'{}i_printf(indent_level + {}, "{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
         elif c["type"].startswith("enum "):
-            print(r'{}i_printf(indent_level + {}, "\"{}\": \"%s\"{}\n", enum_{}_to_str({}{}));'.format(
-                "    " * c_indent_level, json_indent_level, c["name"], line_end, c["type"].split("enum ")[1], var_path, c["name"]))
+            key, key_arg = json_key(c["name"])
+            emit(r'{}i_printf(indent_level + {}, "\"{}\": \"%s\"{}\n"{});'.format(
+                "    " * c_indent_level, json_indent_level, key, line_end,
+                c_args(key_arg, "enum_{}_to_str({})".format(c["type"].split("enum ")[1], load_expr(c, member_load(c, var_path, ""))))))
         else:
             printf_var_str = type_to_fmt_str.get(c["type"])
             if printf_var_str is None:
                 eprint("error: unknown type: {}".format(c["type"]))
                 assert(0)
-            if fmt_type_is_string(c["type"]):
-                printf_var_str = r'\"' + printf_var_str + r'\"'
 
-        if printf_var_str:
+        if c["type"] == "char":
+            # chars are printed as JSON strings, escaped by the runtime
+            if string_len is not None:
+                call = "json_print_string(indent_level + {}, {}, {});".format(json_indent_level, member_expr(var_path, c["name"], array_suffix), string_len)
+            else:
+                call = "json_print_string(indent_level + {}, (const char [1]) {{ {} }}, 1);".format(json_indent_level, member_load(c, var_path, array_suffix))
+            if array_depth:
+                emit("{}{}".format("    " * c_indent_level, call))
+            else:
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": "{});'.format("    " * c_indent_level, json_indent_level, key, c_args(key_arg)))
+                emit("{}{}".format("    " * c_indent_level, call))
+                emit(r'{}i_printf(indent_level + {}, "{}\n");'.format("    " * c_indent_level, json_indent_level, line_end))
+        elif printf_var_str:
+            value = load_expr(c, member_load(c, var_path, array_suffix))
+            if c["type"] in float_format_macros:
+                value = "{}({})".format(float_format_macros[c["type"]], value)
             if array_depth:
-                print(r'{}i_printf(indent_level + {}, "{}", {}{}{});'.format("    " * c_indent_level, json_indent_level, printf_var_str, var_path, c["name"], array_suffix))
+                emit(r'{}i_printf(indent_level + {}, "{}", {});'.format("    " * c_indent_level, json_indent_level, printf_var_str, value))
             else:
-                print(r'{}i_printf(indent_level + {}, "\"{}\": {}{}\n", {}{}{});'.format("    " * c_indent_level, json_indent_level, c["name"], printf_var_str, line_end, var_path, c["name"], array_suffix))
+                key, key_arg = json_key(c["name"])
+                emit(r'{}i_printf(indent_level + {}, "\"{}\": {}{}\n"{});'.format("    " * c_indent_level, json_indent_level, key, printf_var_str, line_end,
+                    c_args(key_arg, value)))
+
+        if flat_array:
+            c_indent_level -= 1
+            emit("{}}}".format("    " * c_indent_level))
+            emit(r'{}i_printf(indent_level + {}, "{}{}\n");'.format("    " * c_indent_level, json_indent_level, "]" * array_depth, line_end))
+            continue
 
         for i in range(array_depth):
             assert(c_indent_level > 0)
             c_indent_level -= 1
             # end of for loop
-            print("{}}}".format("    " * c_indent_level))
+            emit("{}}}".format("    " * c_indent_level))
             if i + 1 < array_depth:
                 special_line_end = ""
             else:
                 special_line_end = line_end + r'\n'
-            print(r'{}i_printf(indent_level + {}, "]{}");'.format("    " * c_indent_level, json_indent_level, special_line_end))
+            emit(r'{}i_printf(indent_level + {}, "]{}");'.format("    " * c_indent_level, json_indent_level, special_line_end))
 
     if print_braces:
         assert(json_indent_level > 0)
         json_indent_level -= 1
-        print(r'{}i_printf(indent_level + {}, "}}");'.format("    " * c_indent_level, json_indent_level))
+        emit(r'{}i_printf(indent_level + {}, "}}");'.format("    " * c_indent_level, json_indent_level))
 
 def generate_c_cases(item, info):
     for name, numeric in item["values"]:
-        print(r'    case {}:'.format(name))
-        print(r'        return "{}";'.format(name))
+        emit(r'    case {}:'.format(name))
+        emit(r'        return "{}";'.format(name))
+
+    emit(r'    default:')
+    emit(r'        return "unknown";')
+
+# Index the definitions of all tagged structs, including nested ones, by type.
+# Members such as "struct foo x;" only carry a reference to the type, the
+# registry resolves them to the definition.
+def build_type_registry(info, registry):
+    for item in info:
+        if not item["type"].startswith("struct "):
+            continue
 
-    print(r'    default:')
-    print(r'        return "unknown";')
+        build_type_registry(item["children"], registry)
 
-def get_structs_to_generate(info, discovered_structs):
+        if item["type"] != "struct " and item["defined"]:
+            registry.setdefault(item["type"], item)
+
+    return registry
+
+# Returns the struct definitions to generate functions for, each one after the
+# structs it depends on.
+def get_structs_to_generate(info, registry, discovered_structs):
     structs_to_gen = []
 
     for item in info:
         if item["type"].startswith("struct "):
-            # Can only generate functions tagged structs
+            # Can only generate functions tagged structs, but untagged ones
+            # may contain tagged definitions
             if item["type"] == "struct ":
+                structs_to_gen.extend(get_structs_to_generate(item["children"], registry, discovered_structs))
                 continue
 
             # previously discovered type
@@ -240,49 +484,1263 @@ def get_structs_to_generate(info, discovered_structs):
                 continue
 
             discovered_structs.add(item["type"])
-            children_structs = get_structs_to_generate(item["children"], discovered_structs)
+            item = registry.get(item["type"], item)
+            children_structs = get_structs_to_generate(item["children"], registry, discovered_structs)
             structs_to_gen.extend(children_structs)
             structs_to_gen.append(item)
 
     return structs_to_gen
 
-def get_enums_to_generate(info):
+def get_enums_to_generate(info, used_enums=None):
     enums_to_gen = []
 
     for item in info:
         if not item["type"].startswith("enum "):
             continue
 
+        if used_enums is not None and item["type"] not in used_enums:
+            continue
+
         enums_to_gen.append(item)
 
     return enums_to_gen
 
-def generate_c_json_prints(info):
-    global c_indent_level, json_indent_level
-
+# Returns the enum types referenced by the given structs, including by their
+# nested untagged structs.
+def get_used_enums(structs, used_enums):
+    for item in structs:
+        for c in item["children"]:
+            if c["type"].startswith("enum "):
+                used_enums.add(c["type"])
+            elif c["type"] == "struct ":
+                get_used_enums([c], used_enums)
+
+    return used_enums
+
+def enum_function_prototype(item):
+    return r"const char *enum_{}_to_str({} e)".format(item["type"].split("enum ")[1], item["type"])
+
+def struct_function_prototype(item):
+    return r"void dump_json_struct_{}(uint32_t indent_level, {} *s)".format(item["type"].split("struct ")[1], item["type"])
+
+def generate_c_enum_function(item, info, cache):
+    if cache and cache.emit_code(item):
+        return
+
+    emit(enum_function_prototype(item))
+    emit(r"{")
+    emit(r'    switch (e) {')
+    generate_c_cases(item, info)
+    emit(r'    }')
+    emit(r"}")
+
+    if cache:
+        cache.store_code(item)
+
+# Set up the byte order conversion of the members of item
+def begin_struct_loads(item):
+    global load_byte_order, load_unaligned_type
+
+    load_byte_order = item.get("byte_order")
+    load_unaligned_type = item["type"] if item.get("unaligned") else None
+
+def generate_c_struct_function(item, info, cache):
+    global c_indent_level
+
+    if cache and cache.emit_code(item):
+        return
+
+    struct_name = item["type"].split("struct ")[1]
+    emit(r"{}{}".format("    " * c_indent_level, struct_function_prototype(item)))
+    emit(r"{}{{".format("    " * c_indent_level))
+    c_indent_level += 1
+    emit(r"#ifdef JSON_STATS")
+    emit(r"{}struct json_stats_probe probe;".format("    " * c_indent_level))
+    emit(r"{}json_stats_begin(&probe);".format("    " * c_indent_level))
+    emit(r"#endif")
+    begin_struct_loads(item)
+    generate_c_json_for_children(item, info, "s->")
+    emit(r"#ifdef JSON_STATS")
+    emit(r"{}json_stats_end(&probe, &json_stats_table[JSON_STRUCT_ID_{}]);".format("    " * c_indent_level, struct_name))
+    emit(r"#endif")
+    c_indent_level -= 1
+    emit(r"{}}}".format("    " * c_indent_level))
+
+    if cache:
+        cache.store_code(item)
+
+# Returns the structs and enums to generate code for, all of them or only
+# those reachable from the roots
+def get_items_to_generate(info, roots):
+    registry = build_type_registry(info, {})
     discovered_structs = set()
-    structs_to_process = get_structs_to_generate(info, discovered_structs)
-    enums_to_process = get_enums_to_generate(info)
+
+    if not roots:
+        return get_structs_to_generate(info, registry, discovered_structs), get_enums_to_generate(info)
+
+    root_items = []
+    for name in roots:
+        item = registry.get("struct " + name)
+        if item is None:
+            eprint("error: root struct {} is not defined".format(name))
+            sys.exit(1)
+        root_items.append(item)
+
+    structs = get_structs_to_generate(root_items, registry, discovered_structs)
+
+    return structs, get_enums_to_generate(info, get_used_enums(structs, set()))
+
+# Annotate the structs with their byte order. The annotation is part of the
+# descriptor, so structs of different byte orders never share code.
+def set_byte_orders(structs, byte_orders):
+    known = set(item["type"].split("struct ")[1] for item in structs)
+    for name in byte_orders:
+        if name != "*" and name not in known:
+            eprint("error: byte order given for unknown struct {}".format(name))
+            sys.exit(1)
+
+    for item in structs:
+        order = byte_orders.get(item["type"].split("struct ")[1], byte_orders.get("*", "native"))
+        if order == "native":
+            item.pop("byte_order", None)
+        else:
+            item["byte_order"] = order
+            warn_bit_fields(item, item)
+
+# The layout of bit-fields depends on the byte order of the compiler, so they
+# are printed as the host's compiler sees them
+def warn_bit_fields(item, c):
+    for child in c["children"]:
+        if child["type"] == "struct ":
+            warn_bit_fields(item, child)
+        elif "bit_size" in child and child["type"] not in single_byte_types:
+            eprint("warning: bit-field {} of {} is not converted to host byte order".format(child["name"], item["type"]))
+
+# Mark the structs whose dumpers may get a pointer at any alignment: packed
+# structs (all structs with unaligned_all), and the structs nested in them.
+def set_unaligned(structs, unaligned_all):
+    by_type = {item["type"]: item for item in structs}
+
+    def mark(item):
+        if item.get("unaligned"):
+            return
+        item["unaligned"] = True
+        mark_children(item)
+
+    def mark_children(item):
+        for c in item["children"]:
+            if c["type"] == "struct ":
+                mark_children(c)
+            elif c["type"] in by_type:
+                mark(by_type[c["type"]])
+
+    for item in structs:
+        item.pop("unaligned", None)
+    for item in structs:
+        if unaligned_all or item.get("packed"):
+            mark(item)
+
+# Structs that differ only in their field names (and tag) have the same
+# shape. Their dumpers share one implementation, taking the JSON keys from a
+# name table passed by a thin wrapper per struct. Structs with bit-fields,
+# which offsetof() can not locate, have no shape (None).
+def struct_shape(item):
+    def strip(d):
+        r = {k: v for k, v in d.items() if k != "name"}
+        r["named"] = d.get("name") is not None
+        if "children" in d:
+            r["children"] = [strip(c) for c in d["children"]]
+        return r
+
+    if struct_has_bitfields(item):
+        return None
+
+    # the byte order changes the generated loads
+    return json.dumps([item.get("byte_order"), item.get("unaligned", False), strip(item)["children"]], sort_keys=True)
+
+# Bit-fields of item, including those of its untagged nested structs
+def struct_has_bitfields(item):
+    for c in item["children"]:
+        if "bit_size" in c or (c["type"] == "struct " and struct_has_bitfields(c)):
+            return True
+
+    return False
+
+# Returns the structs grouped by shape, each group in generation order
+def group_structs_by_shape(structs):
+    groups = {}
+    for item in structs:
+        shape = struct_shape(item)
+        groups.setdefault(item["type"] if shape is None else shape, []).append(item)
+
+    return list(groups.values())
+
+# Returns the paths of the members the dumper of item accesses, e.g. "x" or
+# "inner.x", in the order it accesses them
+def get_member_paths(item, prefix=""):
+    paths = []
+    for c in item["children"]:
+        if c["type"] == "struct ":
+            if c["name"] is None:
+                paths.extend(get_member_paths(c, prefix))
+            else:
+                paths.extend(get_member_paths(c, prefix + c["name"] + "."))
+        elif child_is_skipped(c) or c["name"] is None:
+            continue
+        else:
+            paths.append(prefix + c["name"])
+
+    return paths
+
+def shared_function_prototype(item):
+    return r"static void dump_json_shape_{}(uint32_t indent_level, void *s, const char *const *names)".format(item["type"].split("struct ")[1])
+
+def generate_c_shared_struct_functions(items, info, cache):
+    global c_indent_level, shared_type, shared_keys
+
+    if cache and cache.emit_code({"shared": items}):
+        return
+
+    rep = items[0]
+    rep_name = rep["type"].split("struct ")[1]
+    rep_paths = get_member_paths(rep)
+
+    emit(r"// Shared by the structs with the same layout as {}".format(rep["type"]))
+    emit(shared_function_prototype(rep))
+    emit(r"{")
+    c_indent_level += 1
+    shared_type = rep["type"]
+    shared_keys = []
+    begin_struct_loads(rep)
+    generate_c_json_for_children(rep, info, "s->")
+    shared_type = None
+    c_indent_level -= 1
+    emit(r"}")
+
+    for item in items:
+        struct_name = item["type"].split("struct ")[1]
+
+        # get the key names in printed order, without emitting anything
+        shared_type = item["type"]
+        shared_keys = []
+        begin_struct_loads(item)
+        capture(generate_c_json_for_children, item, info, "s->")
+        keys = shared_keys
+        shared_type = shared_keys = None
+
+        if item is not rep:
+            emit(r'_Static_assert(sizeof({}) == sizeof({}), "{} has a different layout");'.format(item["type"], rep["type"], item["type"]))
+            for path, rep_path in zip(get_member_paths(item), rep_paths):
+                emit(r'_Static_assert(offsetof({}, {}) == offsetof({}, {}), "{} has a different layout");'.format(
+                    item["type"], path, rep["type"], rep_path, item["type"]))
+
+        emit(struct_function_prototype(item))
+        emit(r"{")
+        emit(r"    static const char *const names[] = {")
+        for key in keys:
+            emit(r'        "{}",'.format(key))
+        emit(r"    };")
+        emit(r"#ifdef JSON_STATS")
+        emit(r"    struct json_stats_probe probe;")
+        emit(r"    json_stats_begin(&probe);")
+        emit(r"#endif")
+        emit(r"    dump_json_shape_{}(indent_level, s, names);".format(rep_name))
+        emit(r"#ifdef JSON_STATS")
+        emit(r"    json_stats_end(&probe, &json_stats_table[JSON_STRUCT_ID_{}]);".format(struct_name))
+        emit(r"#endif")
+        emit(r"}")
+
+    if cache:
+        cache.store_code({"shared": items})
+
+# Run fn, returning the lines it emitted instead of adding them to the output
+def capture(fn, *args):
+    start = len(out_lines)
+    fn(*args)
+    lines = out_lines[start:]
+    del out_lines[start:]
+
+    return lines
+
+# Returns the generated code as a list of files, each a list of lines. Without
+# split, this is a single file meant to be #included after the input header.
+# With split = (num_shards, header_name, includes), the first file is a header
+# with the prototypes and the others are num_shards translation units of
+# roughly equal size which include it.
+#
+# With roots, only the named structs and the structs and enums reachable from
+# them are generated. With dedup, structs of the same shape share their
+# implementation.
+#
+# byte_orders maps struct names to the byte order of their members ("little"
+# or "big"), "*" sets the default. Other structs are in host byte order.
+#
+# With openmetrics, an OpenMetrics dumper is generated for every struct as
+# well, with csv CSV header and row functions, with positional schema and
+# record functions.
+def generate_c_json_prints(info, cache=None, split=None, roots=None, dedup=True, byte_orders=None, unaligned=False, openmetrics=False, csv=False,
+        positional=False):
+    structs_to_process, enums_to_process = get_items_to_generate(info, roots)
+
+    if byte_orders:
+        set_byte_orders(structs_to_process, byte_orders)
+    set_unaligned(structs_to_process, unaligned)
 
     # TODO: every function needs to know whether they are the first item in the
     # current level or not.
-    for item in enums_to_process:
-        enum_name = item["type"].split("enum ")[1]
-        print(r"const char *enum_{}_to_str({} e)".format(enum_name, item["type"]))
-        print(r"{")
-        print(r'    switch (e) {')
-        generate_c_cases(item, info)
-        print(r'    }')
-        print(r"}")
-
-    for item in structs_to_process:
-        struct_name = item["type"].split("struct ")[1]
-        print(r"{}void dump_json_struct_{}(uint32_t indent_level, {} *s)".format("    " * c_indent_level, struct_name, item["type"]))
-        print(r"{}{{".format("    " * c_indent_level))
+    enum_funcs = [capture(generate_c_enum_function, item, info, cache) for item in enums_to_process]
+    if dedup:
+        # each group is emitted at the position of its first struct, which
+        # comes after everything the group depends on
+        struct_funcs = []
+        for items in group_structs_by_shape(structs_to_process):
+            if len(items) == 1:
+                struct_funcs.append(capture(generate_c_struct_function, items[0], info, cache))
+            else:
+                struct_funcs.append(capture(generate_c_shared_struct_functions, items, info, cache))
+    else:
+        struct_funcs = [capture(generate_c_struct_function, item, info, cache) for item in structs_to_process]
+
+    if openmetrics:
+        registry = build_type_registry(info, {})
+        enums = {item["type"]: item for item in get_enums_to_generate(info)}
+        struct_funcs += [capture(generate_c_openmetrics_function, item, registry, enums, cache) for item in structs_to_process]
+    if csv:
+        registry = build_type_registry(info, {})
+        consts = get_enum_constants(info)
+        struct_funcs += [capture(generate_c_csv_functions, item, registry, consts, cache) for item in structs_to_process]
+    if positional:
+        registry = build_type_registry(info, {})
+        enums = {item["type"]: item for item in get_enums_to_generate(info)}
+        consts = get_enum_constants(info)
+        struct_funcs += [capture(generate_c_positional_functions, item, registry, enums, consts, cache) for item in structs_to_process]
+
+    if split is None:
+        lines = []
+        for f in enum_funcs:
+            lines.extend(f)
+        lines.extend(capture(generate_c_struct_ids, structs_to_process))
+        lines.extend(capture(generate_c_stats_table, structs_to_process, "static "))
+        for f in struct_funcs:
+            lines.extend(f)
+        lines.extend(capture(generate_c_type_table, structs_to_process, enums_to_process, build_type_registry(info, {})))
+
+        return [lines]
+
+    num_shards, header_name, includes = split
+
+    guard = "_{}_".format(re.sub(r"[^A-Za-z0-9]", "_", os.path.basename(header_name)).upper())
+    header = [
+        r"#ifndef {}".format(guard),
+        r"#define {}".format(guard),
+        r"",
+        r"#include <stdint.h>",
+        r"#include <stdbool.h>",
+        r"#include <inttypes.h>",
+        r"",
+        r'#include "util.h"',
+    ]
+    header.extend(r'#include "{}"'.format(inc) for inc in includes)
+    header.append(r"")
+    header.extend(capture(generate_c_struct_ids, structs_to_process))
+    header.extend([
+        r"#ifdef JSON_STATS",
+        r'#include "json_stats.h"',
+        r"extern __thread struct json_struct_stats json_stats_table[JSON_NUM_STRUCTS + 1];",
+        r"void dump_json_stats(uint32_t indent_level);",
+        r"#endif",
+    ])
+    header.extend(enum_function_prototype(item) + ";" for item in enums_to_process)
+    header.extend(struct_function_prototype(item) + ";" for item in structs_to_process)
+    if openmetrics:
+        header.extend(openmetrics_function_prototype(item) + ";" for item in structs_to_process)
+    if csv:
+        for item in structs_to_process:
+            header.extend(proto + ";" for proto in csv_function_prototypes(item))
+    if positional:
+        for item in structs_to_process:
+            header.extend(proto + ";" for proto in positional_function_prototypes(item))
+    header.append(r"")
+    header.append(r"#endif")
+
+    # Largest functions first, each to the currently smallest shard
+    funcs = enum_funcs + struct_funcs
+    sizes = [sum(len(l) + 1 for l in f) for f in funcs]
+    shard_sizes = [0] * num_shards
+    shard_funcs = [[] for _ in range(num_shards)]
+    for idx in sorted(range(len(funcs)), key=lambda i: -sizes[i]):
+        shard = shard_sizes.index(min(shard_sizes))
+        shard_sizes[shard] += sizes[idx]
+        shard_funcs[shard].append(idx)
+
+    files = [header]
+    for shard in range(num_shards):
+        lines = [r'#include "{}"'.format(os.path.basename(header_name))]
+        if shard == 0:
+            lines.extend(capture(generate_c_stats_table, structs_to_process, ""))
+            lines.extend(capture(generate_c_type_table, structs_to_process, enums_to_process, build_type_registry(info, {})))
+        # keep the generation order within a shard
+        for idx in sorted(shard_funcs[shard]):
+            lines.extend(funcs[idx])
+        files.append(lines)
+
+    return files
+
+# Flattened members, for the backends printing every scalar member of a struct
+# on its own (--openmetrics)
+#
+# Members of nested structs are flattened into the struct, tagged ones
+# included, so everything about a member but its value is known when the code
+# is generated. Every scalar member is a leaf with the path of member names
+# leading to it, e.g. ["nested_struct_name_0", "internal_struct_a"], the
+# var_path and suffix to load it with member_load(), and the arrays on the
+# path as (name, dimension, loop variable), outermost first, path_dims of
+# them for each name on the path. Only the indices of the arrays vary at
+# runtime.
+def get_flat_members(item, registry, leaves, var_path="s->", path=(), arrays=(), byte_order=None, path_dims=()):
+    if item["type"] != "struct ":
+        byte_order = item.get("byte_order")
+
+    for c in item["children"]:
+        if child_is_skipped(c):
+            continue
+
+        dims = c.get("array_len", [])
+        if None in dims:
+            continue
+
+        name_path = path if c["name"] is None else path + (c["name"],)
+        c_path_dims = path_dims if c["name"] is None else path_dims + (len(dims),)
+        suffix = ""
+        c_arrays = arrays
+        for idx, dim in enumerate(dims):
+            var = "a{}".format(len(c_arrays))
+            c_arrays += ((c["name"] if idx == 0 else "{}_{}".format(c["name"], idx), dim, var),)
+            suffix += "[{}]".format(var)
+
+        if c["type"] == "struct ":
+            get_flat_members(c, registry, leaves, var_path if c["name"] is None else var_path + c["name"] + suffix + ".", name_path, c_arrays, byte_order, c_path_dims)
+        elif c["type"].startswith("struct "):
+            nested = registry.get(c["type"], c)
+            get_flat_members(nested, registry, leaves, var_path + c["name"] + suffix + ".", name_path, c_arrays, None, c_path_dims)
+        elif c["type"] != "char" and c["name"] is not None:
+            # chars are text, not numbers
+            leaves.append({"path": list(name_path), "path_dims": list(c_path_dims), "var_path": var_path, "suffix": suffix, "c": c,
+                "arrays": list(c_arrays), "byte_order": byte_order})
+
+    return leaves
+
+# printf format of scalar member c, which is not an enum
+def scalar_format(c):
+    m = stdint_type_re.fullmatch(c["type"])
+    if m:
+        return '%" PRI{}{} "'.format("u" if m.group(1) else "i", m.group(2))
+
+    return type_to_fmt_str[c["type"]]
+
+# Value of leaf as a printf argument for scalar_format(), in host byte order
+def leaf_value(leaf):
+    global load_byte_order
+
+    load_byte_order = leaf["byte_order"]
+    return load_expr(leaf["c"], member_load(leaf["c"], leaf["var_path"], leaf["suffix"]))
+
+# Emit the loops over the arrays of leaf, returns the number of loops opened
+def emit_leaf_loops(leaf):
+    global c_indent_level
+
+    for _, dim, var in leaf["arrays"]:
+        emit("{}for (int {} = 0; {} < {}; ++{}) {{".format("    " * c_indent_level, var, var, dim, var))
         c_indent_level += 1
-        generate_c_json_for_children(item, info, "s->")
+
+    return len(leaf["arrays"])
+
+def emit_leaf_loops_end(num_loops):
+    global c_indent_level
+
+    for _ in range(num_loops):
         c_indent_level -= 1
-        print(r"{}}}".format("    " * c_indent_level))
+        emit("{}}}".format("    " * c_indent_level))
+
+# OpenMetrics exposition (--openmetrics)
+#
+# Every leaf of a struct is a metric family named after the struct and the
+# path of the leaf, e.g. test_nested_struct_name_0_internal_struct_a, with the
+# indices of the arrays on the path as labels named after the arrays. Unsigned
+# integers are counters, enums are statesets with the enumerator names as
+# label values, and other members are gauges. The names and labels are string
+# literals in the generated code, only the values are formatted at runtime.
+
+metric_float_format_macros = {
+    "float": "JSON_FORMAT_METRIC_FLOAT",
+    "double": "JSON_FORMAT_METRIC_DOUBLE",
+}
+
+def openmetrics_function_prototype(item):
+    return r"void dump_openmetrics_struct_{}({} *s)".format(item["type"].split("struct ")[1], item["type"])
+
+# Label names must not start with __, which is reserved
+def openmetrics_label_name(name):
+    return name.lstrip("_") or "index"
+
+# Returns the family name, the OpenMetrics type and the label names of every
+# leaf. Names that collide, e.g. the member a_b and the member b of a nested
+# struct a, get a numeric suffix.
+def get_openmetrics_families(item, leaves):
+    struct_name = item["type"].split("struct ")[1]
+    families = []
+    seen = set()
+
+    for leaf in leaves:
+        name = "_".join([struct_name] + leaf["path"])
+        if name in seen:
+            n = 1
+            while "{}_{}".format(name, n) in seen:
+                n += 1
+            eprint("warning: metric {} is not unique, renamed to {}_{}".format(name, name, n))
+            name = "{}_{}".format(name, n)
+        seen.add(name)
+
+        labels = []
+        for array_name, _, _ in leaf["arrays"]:
+            label = openmetrics_label_name(array_name)
+            while label in labels:
+                label += "_"
+            labels.append(label)
+
+        c = leaf["c"]
+        if c["type"].startswith("enum "):
+            metric_type = "stateset"
+        elif c["type"] in metric_float_format_macros or "bit_size" in c or c["type"] == "_Bool":
+            metric_type = "gauge"
+        elif stdint_type_re.fullmatch(c["type"]):
+            metric_type = "counter" if c["type"].startswith("u") else "gauge"
+        else:
+            metric_type = "counter" if c["type"].startswith("unsigned") else "gauge"
+
+        families.append((name, metric_type, labels))
+
+    return families
+
+def generate_c_openmetrics_function(item, registry, enums, cache):
+    global c_indent_level
+
+    leaves = get_flat_members(item, registry, [])
+    families = get_openmetrics_families(item, leaves)
+    # the code depends on the nested structs and enums as well
+    key = {"openmetrics": item["type"], "unaligned": item.get("unaligned", False), "leaves": leaves,
+        "enums": [enums.get(leaf["c"]["type"]) for leaf in leaves]}
+    if cache and cache.emit_code(key):
+        return
+
+    emit(openmetrics_function_prototype(item))
+    emit(r"{")
+    c_indent_level += 1
+    begin_struct_loads(item)
+
+    if not leaves:
+        emit(r"{}(void) s;".format("    " * c_indent_level))
+
+    for leaf, (name, metric_type, labels) in zip(leaves, families):
+        c = leaf["c"]
+        enum = enums.get(c["type"])
+        if metric_type == "stateset" and enum is None:
+            # the values of an enum defined elsewhere are unknown
+            metric_type = "gauge"
+
+        emit(r'{}i_printf(0, "# TYPE {} {}\n");'.format("    " * c_indent_level, name, metric_type))
+        num_loops = emit_leaf_loops(leaf)
+        label_args = "".join(", " + var for _, _, var in leaf["arrays"])
+        label_strs = [r'{}=\"%d\"'.format(label) for label in labels]
+
+        if metric_type == "stateset":
+            # a block of its own for v
+            emit("{}{{".format("    " * c_indent_level))
+            c_indent_level += 1
+            emit("{}{} v = {};".format("    " * c_indent_level, c["type"], leaf_value(leaf)))
+            for state, _ in enum["values"]:
+                sample_labels = ",".join(label_strs + [r'{}=\"{}\"'.format(name, state)])
+                emit(r'{}i_printf(0, "{}{{{}}} %d\n"{}, v == {});'.format("    " * c_indent_level, name, sample_labels, label_args, state))
+            c_indent_level -= 1
+            emit("{}}}".format("    " * c_indent_level))
+        else:
+            sample = name + ("_total" if metric_type == "counter" else "")
+            if label_strs:
+                sample += "{" + ",".join(label_strs) + "}"
+            if c["type"] in metric_float_format_macros:
+                fmt, value = "%s", "{}({})".format(metric_float_format_macros[c["type"]], leaf_value(leaf))
+            else:
+                fmt, value = scalar_format(c), leaf_value(leaf)
+            emit(r'{}i_printf(0, "{} {}\n"{}, {});'.format("    " * c_indent_level, sample, fmt, label_args, value))
+
+        emit_leaf_loops_end(num_loops)
+
+    c_indent_level -= 1
+    emit(r"}")
+
+    if cache:
+        cache.store_code(key)
+
+# CSV export (--csv)
+#
+# A struct is a row with a column for every element of every leaf, e.g.
+# nested_struct_name_0.internal_struct_a or grid[1][2][3]. The header row and
+# the longest possible row are computed when the code is generated, so the
+# array dimensions have to be constant expressions of numbers and enumerators.
+# Rows are formatted into the batch buffer of the runtime, without printf().
+
+# Bytes of a formatted integer (see json_format_u64() and json_format_i64())
+# and float (JSON_FLOAT_BUF_SIZE, including the NUL overwritten by the
+# separator) column
+CSV_INT_WIDTH = 20
+CSV_FLOAT_WIDTH = 32
+
+# Values of the enumerators of the enums in info, by name
+def get_enum_constants(info):
+    consts = {}
+    for item in get_enums_to_generate(info):
+        for name, v in item["values"]:
+            consts[name] = c_int_constant(v)
+
+    return consts
+
+# Value of the C integer or character constant v
+def c_int_constant(v):
+    v = str(v)
+    if v.startswith("'"):
+        return ord(v[1:-1].encode().decode("unicode_escape"))
+    v = v.rstrip("uUlL")
+    if re.match(r"0[0-7]+$", v):
+        return int(v, 8)
+
+    return int(v, 0)
+
+# Value of the array dimension dim, a C constant expression
+def eval_dim(dim, consts):
+    expr = re.sub(r"\b(0[xX][0-9a-fA-F]+|[0-9]+)[uUlL]+\b", r"\1", dim).replace("/", "//")
+    try:
+        return int(eval(expr, {"__builtins__": {}}, consts))
+    except Exception:
+        eprint("error: array dimension {} is not a constant".format(dim))
+        sys.exit(1)
+
+# Column names of leaf, in the order of the loops over its arrays
+def get_csv_columns(leaf, consts):
+    columns = [""]
+    arrays = iter(leaf["arrays"])
+    for idx, (name, num_dims) in enumerate(zip(leaf["path"], leaf["path_dims"])):
+        if idx:
+            columns = [col + "." for col in columns]
+        columns = [col + name for col in columns]
+        for _ in range(num_dims):
+            dim = eval_dim(next(arrays)[1], consts)
+            columns = ["{}[{}]".format(col, i) for col in columns for i in range(dim)]
+
+    return columns
+
+def csv_function_prototypes(item):
+    struct_name = item["type"].split("struct ")[1]
+    return [
+        r"void dump_csv_header_{}(char sep)".format(struct_name),
+        r"void dump_csv_rows_{}({} *rows, size_t n, char sep)".format(struct_name, item["type"]),
+    ]
+
+def generate_c_csv_functions(item, registry, consts, cache):
+    global c_indent_level
+
+    leaves = get_flat_members(item, registry, [])
+    key = {"csv": item["type"], "unaligned": item.get("unaligned", False), "leaves": leaves, "consts": consts}
+    if cache and cache.emit_code(key):
+        return
+
+    struct_name = item["type"].split("struct ")[1]
+    columns = []
+    row_max = 1
+    for leaf in leaves:
+        leaf_columns = get_csv_columns(leaf, consts)
+        columns.extend(leaf_columns)
+        width = CSV_FLOAT_WIDTH if leaf["c"]["type"] in float_format_macros else CSV_INT_WIDTH
+        row_max += len(leaf_columns) * (width + 1)
+
+    header_proto, rows_proto = csv_function_prototypes(item)
+    emit(r"static const char csv_header_{}[] =".format(struct_name))
+    line = ""
+    for idx, col in enumerate(columns):
+        line += col + ("," if idx + 1 < len(columns) else "")
+        if len(line) >= 100:
+            emit(r'    "{}"'.format(line))
+            line = ""
+    emit(r'    "{}\n";'.format(line))
+    emit(header_proto)
+    emit(r"{")
+    emit(r"    json_csv_header(csv_header_{0}, sizeof(csv_header_{0}) - 1, sep);".format(struct_name))
+    emit(r"}")
+
+    emit(rows_proto)
+    emit(r"{")
+    emit(r"    for (size_t r = 0; r < n; ++r) {")
+    emit(r"        {} *s = &rows[r];".format(item["type"]))
+    emit(r"        char *p = json_batch_begin({});".format(row_max))
+    c_indent_level += 2
+    begin_struct_loads(item)
+
+    if not leaves:
+        emit(r"        (void) s;")
+        emit(r"        (void) sep;")
+
+    for leaf in leaves:
+        c = leaf["c"]
+        num_loops = emit_leaf_loops(leaf)
+        if c["type"] == "float":
+            fmt = "json_csv_float"
+        elif c["type"] == "double":
+            fmt = "json_csv_double"
+        elif c["type"] == "_Bool" or c["type"].startswith("u"):
+            fmt = "json_format_u64"
+        else:
+            fmt = "json_format_i64"
+        emit(r"{}p = {}(p, {});".format("    " * c_indent_level, fmt, leaf_value(leaf)))
+        emit(r"{}*p++ = sep;".format("    " * c_indent_level))
+        emit_leaf_loops_end(num_loops)
+
+    if leaves:
+        # the last separator ends the row
+        emit(r"        p[-1] = '\n';")
+    else:
+        emit(r"        *p++ = '\n';")
+    emit(r"        json_batch_end(p);")
+    emit(r"    }")
+    emit(r"    json_batch_flush();")
+    emit(r"}")
+    c_indent_level -= 2
+
+    if cache:
+        cache.store_code(key)
+
+# Positional JSON (--positional)
+#
+# The keys of a struct are printed once, in a schema document describing its
+# JSON dump: the members in order, with their key, type and array shape,
+# nested structs as members with fields of their own. A record is then a
+# compact JSON array of the struct ID (JSON_STRUCT_ID_<name>, the schema's
+# ID) and the values in that order, arrays flattened in row-major order,
+# elements of arrays of structs one after the other. Chars are JSON strings,
+# enums are numbers, which the schema maps to their names.
+# json_positional_decode.py turns records back into the JSON of the dumpers.
+
+# Bytes of a string value of n chars (see json_batch_string()) and a comma
+def positional_string_width(n):
+    return 6 * n + 3
+
+def positional_function_prototypes(item):
+    struct_name = item["type"].split("struct ")[1]
+    return [
+        r"void dump_json_schema_{}(void)".format(struct_name),
+        r"void dump_json_records_{}({} *rows, size_t n)".format(struct_name, item["type"]),
+    ]
+
+# Emit the code appending the values of the members of item to the record and
+# return their schema fields. width[0] is increased by the longest output of
+# every value.
+def generate_c_positional_fields(item, registry, consts, var_path, byte_order, width, depth=0):
+    global c_indent_level, load_byte_order
+
+    if item["type"] != "struct ":
+        byte_order = item.get("byte_order")
+
+    fields = []
+    for c in item["children"]:
+        if child_is_skipped(c):
+            continue
+
+        dims = c.get("array_len", [])
+        if None in dims:
+            continue
+
+        string_len = None
+        if c["type"] == "char" and dims:
+            # the innermost dimension of a char array is a string
+            string_len = eval_dim(dims[-1], consts)
+            dims = dims[:-1]
+
+        if c["type"] == "struct " and c["name"] is None:
+            # members of anonymous structs are members of the enclosing one
+            fields.extend(generate_c_positional_fields(c, registry, consts, var_path, byte_order, width, depth))
+            continue
+        elif c["name"] is None:
+            continue
+
+        shape = [eval_dim(dim, consts) for dim in dims]
+        count = 1
+        for dim in shape:
+            count *= dim
+
+        suffix = ""
+        for idx, dim in enumerate(dims):
+            var = "a{}".format(depth + idx)
+            emit("{}for (int {} = 0; {} < {}; ++{}) {{".format("    " * c_indent_level, var, var, dim, var))
+            c_indent_level += 1
+            suffix += "[{}]".format(var)
+
+        if c["type"].startswith("struct "):
+            nested = c if c["type"] == "struct " else registry.get(c["type"], c)
+            # tagged structs are printed by their own dumper, under their tag
+            key = c["name"] if c["type"] == "struct " else c["type"].split("struct ")[1]
+            nested_width = [0]
+            field = {"key": key, "fields": generate_c_positional_fields(nested, registry, consts, var_path + c["name"] + suffix + ".",
+                byte_order, nested_width, depth + len(dims))}
+            width[0] += count * nested_width[0]
+        else:
+            load_byte_order = byte_order
+            if c["type"] == "char":
+                field = {"key": c["name"], "type": "string" if string_len is not None else "char"}
+                if string_len is not None:
+                    value = "json_batch_string(p, {}, {})".format(member_expr(var_path, c["name"], suffix), string_len)
+                else:
+                    value = "json_batch_string(p, (const char [1]) {{ {} }}, 1)".format(member_load(c, var_path, suffix))
+                width[0] += count * positional_string_width(string_len or 1)
+            else:
+                field = {"key": c["name"], "type": c["type"]}
+                v = load_expr(c, member_load(c, var_path, suffix))
+                if c["type"] in float_format_macros:
+                    value = "json_batch_{}(p, {})".format(c["type"], v)
+                    width[0] += count * (CSV_FLOAT_WIDTH + 1)
+                else:
+                    unsigned = c["type"] == "_Bool" or c["type"].startswith("u")
+                    value = "json_format_{}(p, {})".format("u64" if unsigned else "i64", v)
+                    width[0] += count * (CSV_INT_WIDTH + 1)
+            emit("{}p = {};".format("    " * c_indent_level, value))
+            emit("{}*p++ = ',';".format("    " * c_indent_level))
+
+        if shape:
+            field["shape"] = shape
+        fields.append(field)
+
+        for _ in dims:
+            c_indent_level -= 1
+            emit("{}}}".format("    " * c_indent_level))
+
+    return fields
+
+# Definitions of the tagged structs nested in item, at any depth
+def get_nested_types(item, registry, found=None):
+    if found is None:
+        found = {}
+
+    for c in item["children"]:
+        if c["type"] == "struct ":
+            get_nested_types(c, registry, found)
+        elif c["type"].startswith("struct ") and c["type"] not in found and c["type"] in registry:
+            found[c["type"]] = registry[c["type"]]
+            get_nested_types(registry[c["type"]], registry, found)
+
+    return found
+
+# JSON text of the schema fields as a printf format and its arguments: the
+# numbers of the enumerators are printed by the compiler's values
+def positional_schema_text(fields, enums, fmt, args):
+    fmt.append("[")
+    for idx, field in enumerate(fields):
+        fmt.append(r'{}{{\"key\":\"{}\"'.format("," if idx else "", field["key"]))
+        if "fields" in field:
+            fmt.append(r',\"fields\":')
+            positional_schema_text(field["fields"], enums, fmt, args)
+        else:
+            fmt.append(r',\"type\":\"{}\"'.format(field["type"]))
+            enum = enums.get(field["type"])
+            if enum is not None:
+                fmt.append(r',\"values\":{')
+                for v_idx, (name, _) in enumerate(enum["values"]):
+                    fmt.append(r'{}\"%lld\":\"{}\"'.format("," if v_idx else "", name))
+                    args.append("(long long) {}".format(name))
+                fmt.append("}")
+        if "shape" in field:
+            fmt.append(r',\"shape\":[{}]'.format(",".join(str(dim) for dim in field["shape"])))
+        fmt.append("}")
+    fmt.append("]")
+
+def generate_c_positional_functions(item, registry, enums, consts, cache):
+    global c_indent_level
+
+    # the code depends on the nested structs and enums as well
+    key = {"positional": item, "unaligned": item.get("unaligned", False), "registry": get_nested_types(item, registry),
+        "enums": enums, "consts": consts}
+    if cache and cache.emit_code(key):
+        return
+
+    struct_name = item["type"].split("struct ")[1]
+    schema_proto, records_proto = positional_function_prototypes(item)
+
+    begin_struct_loads(item)
+    width = [0]
+    c_indent_level += 2
+    start = len(out_lines)
+    fields = generate_c_positional_fields(item, registry, consts, "s->", None, width)
+    value_lines = out_lines[start:]
+    del out_lines[start:]
+    c_indent_level -= 2
+
+    fmt = []
+    args = []
+    positional_schema_text(fields, enums, fmt, args)
+
+    emit(schema_proto)
+    emit(r"{")
+    emit(r'    i_printf(0, "{{\"schema\":%d,\"type\":\"{}\",\"fields\":["{});'.format(struct_name, c_args("JSON_STRUCT_ID_" + struct_name)))
+    # one printf per top level field, within the brackets of the list
+    line, line_args, nesting = "", [], 1
+    fmt = fmt[1:-1]
+    arg_iter = iter(args)
+    for piece in fmt:
+        line += piece
+        line_args.extend(next(arg_iter) for _ in range(piece.count("%lld")))
+        nesting += piece.count("[") - piece.count("]") + piece.count("{") - piece.count("}")
+        if nesting == 1:
+            emit(r'    i_printf(0, "{}"{});'.format(line, c_args(*line_args)))
+            line, line_args = "", []
+    emit(r'    i_printf(0, "]}\n");')
+    emit(r"}")
+
+    emit(records_proto)
+    emit(r"{")
+    emit(r"    for (size_t r = 0; r < n; ++r) {")
+    emit(r"        {} *s = &rows[r];".format(item["type"]))
+    # [ID, values ] and a newline
+    emit(r"        char *p = json_batch_begin({});".format(width[0] + CSV_INT_WIDTH + 4))
+    emit(r"        *p++ = '[';")
+    emit(r"        p = json_format_u64(p, JSON_STRUCT_ID_{});".format(struct_name))
+    if value_lines:
+        emit(r"        *p++ = ',';")
+        out_lines.extend(value_lines)
+        # the last comma ends the record
+        emit(r"        p[-1] = ']';")
+    else:
+        emit(r"        (void) s;")
+        emit(r"        *p++ = ']';")
+    emit(r"        *p++ = '\n';")
+    emit(r"        json_batch_end(p);")
+    emit(r"    }")
+    emit(r"    json_batch_flush();")
+    emit(r"}")
+
+    if cache:
+        cache.store_code(key)
+
+# C++ reflection (--cxx)
+#
+# Instead of C code, a C++ header is generated with constexpr descriptors of
+# every struct and enum, for the template serializer in json_reflect.hpp.
+# In C++, struct definitions nested in another struct are scoped to it, and
+# untagged ones have no name at all, so nested struct types are named through
+# the enclosing type.
+
+def cxx_string(s):
+    return '"{}"'.format(s.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n"))
+
+# Name the C++ types of the structs nested in item, whose C++ type is expr.
+# Tagged ones are added to tagged_types by C type, untagged ones with a name
+# get an alias in aliases and are added to untagged_types by id.
+def get_cxx_nested_types(item, expr, alias_prefix, tagged_types, untagged_types, aliases):
+    for c in item["children"]:
+        if not c["type"].startswith("struct ") or not c.get("defined"):
+            continue
+
+        if c["type"] != "struct ":
+            c_expr = "{}::{}".format(expr, c["type"].split("struct ")[1])
+            tagged_types.setdefault(c["type"], c_expr)
+            get_cxx_nested_types(c, c_expr, c["type"].split("struct ")[1], tagged_types, untagged_types, aliases)
+        elif c["name"] is None:
+            # members of anonymous structs are members of the enclosing one
+            get_cxx_nested_types(c, expr, alias_prefix, tagged_types, untagged_types, aliases)
+        else:
+            alias = "{}__{}".format(alias_prefix, c["name"])
+            while alias in aliases:
+                alias += "_"
+            aliases[alias] = "std::remove_all_extents_t<decltype({}::{})>".format(expr, c["name"])
+            c_expr = "types::" + alias
+            untagged_types[id(c)] = c_expr
+            get_cxx_nested_types(c, c_expr, alias, tagged_types, untagged_types, aliases)
+
+# Returns the (name, field constructor, member) of every member printed for
+# item. Bit-fields are read through a function, others through a member
+# pointer.
+def get_cxx_fields(item, expr):
+    fields = []
+    for c in item["children"]:
+        if child_is_skipped(c):
+            continue
+        if c["type"] == "struct " and c["name"] is None:
+            fields.extend(get_cxx_fields(c, expr))
+        elif c["name"] is None:
+            continue
+        elif "bit_size" in c:
+            fields.append((c["name"], "make_bitfield", "+[](const {} &s) {{ return s.{}; }}".format(expr, c["name"])))
+        else:
+            fields.append((c["name"], "make_field", "&{}::{}".format(expr, c["name"])))
+
+    return fields
+
+def generate_cxx_struct_descriptor(name, item, expr, untagged_types):
+    # named untagged structs are printed like structs, named by their member
+    for c in item["children"]:
+        if c["type"].startswith("struct ") and c.get("defined"):
+            if id(c) in untagged_types:
+                generate_cxx_struct_descriptor(c["name"], c, untagged_types[id(c)], untagged_types)
+            elif c["type"] == "struct ":
+                generate_cxx_nested_untagged(c, untagged_types)
+
+    fields = get_cxx_fields(item, expr)
+
+    emit(r"template <>")
+    emit(r"struct descriptor<{}> {{".format(expr))
+    emit(r"    static constexpr std::string_view name = {};".format(cxx_string(name)))
+    emit(r"    static constexpr std::string_view open = {};".format(cxx_string('"{}": {{\n'.format(name))))
+    emit(r"    static constexpr auto fields = std::make_tuple(")
+    for idx, (field_name, make, member) in enumerate(fields):
+        emit(r"        {}({}, {}, {}){}".format(make, cxx_string(field_name), cxx_string('"{}": '.format(field_name)),
+            member, "," if idx + 1 < len(fields) else ""))
+    emit(r"    );")
+    emit(r"};")
+    emit(r"")
+
+# Descriptors of the named untagged structs inside an anonymous one
+def generate_cxx_nested_untagged(item, untagged_types):
+    for c in item["children"]:
+        if id(c) in untagged_types:
+            generate_cxx_struct_descriptor(c["name"], c, untagged_types[id(c)], untagged_types)
+        elif c["type"] == "struct " and c.get("defined"):
+            generate_cxx_nested_untagged(c, untagged_types)
+
+def generate_cxx_enum_descriptor(item):
+    expr = "::" + item["type"].split("enum ")[1]
+
+    emit(r"template <>")
+    emit(r"struct enum_descriptor<{}> {{".format(expr))
+    emit(r"    static constexpr std::string_view to_str({} e)".format(expr))
+    emit(r"    {")
+    emit(r"        switch (e) {")
+    for name, numeric in item["values"]:
+        emit(r"        case {}:".format(name))
+        emit(r'            return "{}";'.format(name))
+    emit(r"        default:")
+    emit(r'            return "unknown";')
+    emit(r"        }")
+    emit(r"    }")
+    emit(r"};")
+    emit(r"")
+
+def generate_cxx_reflection(info, header_name, includes, roots=None):
+    structs, enums = get_items_to_generate(info, roots)
+
+    tagged_types = {}
+    untagged_types = {}
+    aliases = {}
+    for item in info:
+        if item["type"].startswith("struct ") and item["type"] != "struct " and item.get("defined"):
+            expr = "::" + item["type"].split("struct ")[1]
+            tagged_types.setdefault(item["type"], expr)
+            get_cxx_nested_types(item, expr, item["type"].split("struct ")[1], tagged_types, untagged_types, aliases)
+
+    guard = "_{}_".format(re.sub(r"[^A-Za-z0-9]", "_", os.path.basename(header_name or "reflect.hpp")).upper())
+    emit(r"#ifndef {}".format(guard))
+    emit(r"#define {}".format(guard))
+    emit(r"")
+    emit(r'#include "json_reflect.hpp"')
+    for inc in includes:
+        emit(r'#include "{}"'.format(inc))
+    emit(r"")
+    emit(r"namespace json_reflect {")
+    emit(r"")
+    if aliases:
+        emit(r"// Nested struct types, named after the members declaring them")
+        emit(r"namespace types {")
+        for alias, expr in aliases.items():
+            emit(r"using {} = {};".format(alias, expr))
+        emit(r"}")
+        emit(r"")
+
+    for item in enums:
+        generate_cxx_enum_descriptor(item)
+
+    for item in structs:
+        generate_cxx_struct_descriptor(item["type"].split("struct ")[1], item, tagged_types[item["type"]], untagged_types)
+
+    emit(r"} // namespace json_reflect")
+    emit(r"")
+    emit(r"#endif")
+
+# Every generated struct gets a numeric ID (its index in generation order).
+# The IDs key the instrumentation table and the type table.
+def generate_c_struct_ids(structs):
+    emit(r"enum {")
+    for struct_id, item in enumerate(structs):
+        emit(r"    JSON_STRUCT_ID_{} = {},".format(item["type"].split("struct ")[1], struct_id))
+    emit(r"    JSON_NUM_STRUCTS = {}".format(len(structs)))
+    emit(r"};")
+
+# When compiled with -DJSON_STATS, every dumper records its statistics into a
+# per-thread table indexed by struct ID. The table and a function to export it
+# as JSON are emitted here. table_storage is "static " unless the table is
+# shared between translation units.
+def generate_c_stats_table(structs, table_storage):
+    emit(r"#ifdef JSON_STATS")
+    emit(r'#include "json_stats.h"')
+    emit(r"// + 1 keeps the arrays non-empty for headers without any structs")
+    emit(r"static const char *const json_stats_names[JSON_NUM_STRUCTS + 1] = {")
+    for item in structs:
+        emit(r'    "{}",'.format(item["type"].split("struct ")[1]))
+    emit(r"};")
+    emit(r"{}__thread struct json_struct_stats json_stats_table[JSON_NUM_STRUCTS + 1];".format(table_storage))
+    emit(r"")
+    emit(r"// Export the calling thread's statistics of every struct dumped so far")
+    emit(r"void dump_json_stats(uint32_t indent_level)")
+    emit(r"{")
+    emit(r"    bool first = true;")
+    emit(r"")
+    emit(r'    i_printf(indent_level, "\"json_stats\": {\n");')
+    emit(r"    for (int i = 0; i < JSON_NUM_STRUCTS; ++i) {")
+    emit(r"        if (!json_stats_table[i].calls) {")
+    emit(r"            continue;")
+    emit(r"        }")
+    emit(r"        if (!first) {")
+    emit(r'            i_printf(indent_level + 1, ",\n");')
+    emit(r"        }")
+    emit(r"        json_stats_dump_entry(indent_level + 1, json_stats_names[i], &json_stats_table[i]);")
+    emit(r"        first = false;")
+    emit(r"    }")
+    emit(r'    i_printf(indent_level, "\n}");')
+    emit(r"}")
+    emit(r"#endif")
+
+# The hash of the type lookups, json_type_hash() in json_types.h
+def json_type_hash(name, seed):
+    h = 2166136261 ^ seed
+    for c in name.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+
+    return h
+
+# Minimal perfect hash of names by hash and displace: names are put into
+# len(names) buckets by their hash with seed 0, and the buckets are placed
+# largest first. A bucket of several names gets the smallest seed > 0 that
+# hashes them to distinct free slots, a bucket of one name the free slot s
+# directly, stored as -s - 1. Returns the seed or slot of every bucket and the
+# index of the name in every slot.
+def build_perfect_hash(names):
+    n = len(names)
+    buckets = [[] for _ in range(n)]
+    for idx, name in enumerate(names):
+        buckets[json_type_hash(name, 0) % n].append(idx)
+
+    disps = [0] * n
+    slots = [None] * n
+    order = sorted(range(n), key=lambda b: -len(buckets[b]))
+    for b in order:
+        if len(buckets[b]) < 2:
+            break
+        seed = 1
+        while True:
+            tried = [json_type_hash(names[idx], seed) % n for idx in buckets[b]]
+            if len(set(tried)) == len(tried) and all(slots[t] is None for t in tried):
+                break
+            seed += 1
+        disps[b] = seed
+        for idx, t in zip(buckets[b], tried):
+            slots[t] = idx
+
+    free = [t for t in range(n) if slots[t] is None]
+    for b in order:
+        if len(buckets[b]) == 1:
+            t = free.pop()
+            disps[b] = -t - 1
+            slots[t] = buckets[b][0]
+
+    return disps, slots
+
+# Emits the hash tables and lookup function of a table of num entries
+def generate_c_type_lookup(names, prefix, info_type, table, num):
+    emit(r"const struct {} *{}_lookup(const char *name)".format(info_type, prefix))
+    emit(r"{")
+    if not names:
+        emit(r"    (void) name;")
+        emit(r"    return NULL;")
+        emit(r"}")
+        return
+
+    disps, slots = build_perfect_hash(names)
+    emit(r"    static const int32_t disps[{}] = {{ {} }};".format(num, ", ".join(str(d) for d in disps)))
+    emit(r"    static const uint32_t slots[{}] = {{ {} }};".format(num, ", ".join(str(t) for t in slots)))
+    emit(r"    int32_t d = disps[json_type_hash(name, 0) % {}];".format(num))
+    emit(r"    uint32_t slot = d < 0 ? (uint32_t) -(d + 1) : json_type_hash(name, (uint32_t) d) % {};".format(num))
+    emit(r"    const struct {} *t = &{}[slots[slot]];".format(info_type, table))
+    emit(r"")
+    emit(r"    return strcmp(t->name, name) == 0 ? t : NULL;")
+    emit(r"}")
+
+# When compiled with -DJSON_TYPE_TABLE, tables describing every generated
+# struct (indexed by struct ID) and enum are emitted so that code can iterate
+# over all dumpers without knowing their names, or find them by name, see
+# json_types.h.
+def generate_c_type_table(structs, enums, registry):
+    global c_indent_level
+
+    struct_names = [item["type"].split("struct ")[1] for item in structs]
+    enum_names = [item["type"].split("enum ")[1] for item in enums]
+
+    emit(r"#ifdef JSON_TYPE_TABLE")
+    emit(r"#include <string.h>")
+    emit(r'#include "json_types.h"')
+    for struct_name in struct_names:
+        emit(r"static void dump_json_any_{}(uint32_t indent_level, void *p)".format(struct_name))
+        emit(r"{")
+        emit(r"    dump_json_struct_{}(indent_level, p);".format(struct_name))
+        emit(r"}")
+    # Any bytes are a valid value of the other members, an enum member out of
+    # range is printed as "unknown"
+    fixed = set()
+    for struct_name, item in zip(struct_names, structs):
+        bools = [leaf for leaf in get_flat_members(item, registry, [])
+            if leaf["c"]["type"] == "_Bool" and "bit_size" not in leaf["c"]]
+        if not bools:
+            continue
+        fixed.add(struct_name)
+        emit(r"static void fix_json_any_{}(void *p)".format(struct_name))
+        emit(r"{")
+        emit(r"    {} *s = p;".format(item["type"]))
+        emit(r"")
+        c_indent_level = 1
+        for leaf in bools:
+            num_loops = emit_leaf_loops(leaf)
+            emit(r"{}*(unsigned char *) &{}{}{} &= 1;".format("    " * c_indent_level, leaf["var_path"], leaf["c"]["name"], leaf["suffix"]))
+            emit_leaf_loops_end(num_loops)
+        c_indent_level = 0
+        emit(r"}")
+    for enum_name in enum_names:
+        emit(r"static const char *enum_any_{}_to_str(int64_t value)".format(enum_name))
+        emit(r"{")
+        emit(r"    return enum_{0}_to_str((enum {0}) value);".format(enum_name))
+        emit(r"}")
+    emit(r"const struct json_type_info json_types[JSON_NUM_STRUCTS + 1] = {")
+    for struct_id, (struct_name, item) in enumerate(zip(struct_names, structs)):
+        emit(r'    {{ "{0}", sizeof({1}), dump_json_any_{0}, {2}, {3} }},'.format(struct_name, item["type"], struct_id,
+            "fix_json_any_" + struct_name if struct_name in fixed else "NULL"))
+    emit(r"};")
+    emit(r"const size_t json_num_types = JSON_NUM_STRUCTS;")
+    emit(r"const struct json_enum_info json_enums[{}] = {{".format(len(enums) + 1))
+    for enum_id, enum_name in enumerate(enum_names):
+        emit(r'    {{ "{0}", sizeof(enum {0}), enum_any_{0}_to_str, {1} }},'.format(enum_name, enum_id))
+    emit(r"};")
+    emit(r"const size_t json_num_enums = {};".format(len(enums)))
+    emit(r"")
+    generate_c_type_lookup(struct_names, "json_type", "json_type_info", "json_types", "JSON_NUM_STRUCTS")
+    emit(r"")
+    generate_c_type_lookup(enum_names, "json_enum", "json_enum_info", "json_enums", len(enums))
+    emit(r"#endif")
 
 def gen_enum(ast):
     r = {
@@ -296,13 +1754,14 @@ def gen_enum(ast):
         value = x.value
         if value is None:
             value = next_value
-            next_value += 1
         elif isinstance(value, pycparser.c_ast.Constant):
             value = value.value
         else:
             assert(0)
 
         values.append((x.name, value))
+        # an enumerator without a value follows the previous one
+        next_value = c_int_constant(value) + 1
 
     r["values"] = values
 
@@ -311,23 +1770,19 @@ def gen_enum(ast):
 def gen_type_decl(x):
     child = None
 
-    eprint("typedecl-begin")
+    dprint("typedecl-begin")
     if isinstance(x.type, pycparser.c_ast.IdentifierType):
-        eprint("typedecl-identifier-begin")
-        eprint(dir(x))
-        eprint(dir(x.type))
+        dprint("typedecl-identifier-begin")
         child = {
             "type": " ".join(x.type.names),
         }
-        eprint("typedecl-identifier-end")
+        dprint("typedecl-identifier-end")
     elif isinstance(x.type, pycparser.c_ast.Enum):
-        eprint("typedecl-enum-begin")
-        eprint(dir(x))
-        eprint(dir(x.type))
+        dprint("typedecl-enum-begin")
         child = {
             "type": "enum " + x.type.name,
         }
-        eprint("typedecl-enum-end")
+        dprint("typedecl-enum-end")
     elif isinstance(x.type, pycparser.c_ast.Struct):
         child = gen_struct(x.type)
     else:
@@ -338,7 +1793,9 @@ def gen_type_decl(x):
 def gen_struct(ast):
     r = {
         "type": "struct {}".format(ast.name),
-        "children": []
+        "children": [],
+        # False for references to a type, e.g. "struct foo x;"
+        "defined": ast.decls is not None,
     }
 
     # special case there the name is None for anonymous structs
@@ -348,11 +1805,10 @@ def gen_struct(ast):
     if ast.decls is None:
         return r
 
-    eprint("begin")
-    eprint(dir(ast))
+    dprint("begin")
     for x in ast.decls:
-        eprint("decl-begin")
-        eprint(x)
+        dprint("decl-begin")
+        dprint(x)
         child = None
         if isinstance(x, pycparser.c_ast.Decl):
             child = gen_decl(x)
@@ -361,8 +1817,8 @@ def gen_struct(ast):
 
         if child:
             r["children"].append(child)
-        eprint("decl-end")
-    eprint("end")
+        dprint("decl-end")
+    dprint("end")
 
     return r
 
@@ -378,12 +1834,15 @@ def gen_array_decl(x):
         x = x.type
 
     if isinstance(x.type, pycparser.c_ast.TypeDecl):
-        eprint("begin typedecl")
+        dprint("begin typedecl")
         s = gen_type_decl(x.type)
         if s is not None:
-            s["array_len"] = dimensions
-        eprint(s)
-        eprint("end typedecl")
+            # bounds are kept as C expression strings, None for flexible
+            # array members
+            s["array_len"] = [None if dim is None else get_array_bounds_string(dimensions, idx)
+                for idx, dim in enumerate(dimensions)]
+        dprint(s)
+        dprint("end typedecl")
     else:
         eprint("don't know how to handle array decl: {}".format(x))
         assert(0)
@@ -394,62 +1853,674 @@ def gen_decl(x):
     s = None
 
     if isinstance(x.type, pycparser.c_ast.Struct):
-        eprint("begin struct")
-        eprint(x.type)
+        dprint("begin struct")
+        dprint(x.type)
         s = gen_struct(x.type)
-        eprint("end struct")
+        dprint("end struct")
     elif isinstance(x.type, pycparser.c_ast.Enum):
-        eprint("begin enum")
-        eprint(x.type)
+        dprint("begin enum")
+        dprint(x.type)
         s = gen_enum(x.type)
-        eprint(s)
-        eprint("end enum")
+        dprint(s)
+        dprint("end enum")
     elif isinstance(x.type, pycparser.c_ast.FuncDecl):
-        eprint("skipping function declaration: {}".format(x))
+        dprint("skipping function declaration:", x)
     elif isinstance(x.type, pycparser.c_ast.TypeDecl):
-        eprint("begin typedecl")
+        dprint("begin typedecl")
         s = gen_type_decl(x.type)
-        eprint(s)
-        eprint("end typedecl")
+        dprint(s)
+        dprint("end typedecl")
     elif isinstance(x.type, pycparser.c_ast.ArrayDecl):
-        eprint("begin arraydecl")
+        dprint("begin arraydecl")
         s = gen_array_decl(x.type)
-        eprint(s)
-        eprint("end arraydecl")
+        dprint(s)
+        dprint("end arraydecl")
     else:
         eprint("don't know how to handle decl: {}".format(x))
         assert(0)
 
     if s is not None:
         s["name"] = x.name
+        if x.bitsize is not None:
+            s["bit_size"] = x.bitsize.value
 
     return s
 
-def main():
-    ast = pycparser.parse_file(sys.argv[1])
+# Returns the descriptor of a top level declaration, or None if there is
+# nothing to generate for it.
+def gen_ext_decl(x):
+    dprint("begin loop")
+    dprint(x)
 
-    result = []
+    s = None
+    if isinstance(x, pycparser.c_ast.FuncDef):
+        pass
+    elif isinstance(x, pycparser.c_ast.Decl):
+        s = gen_decl(x)
+    elif isinstance(x, pycparser.c_ast.Typedef):
+        dprint("skipping typedef {}".format(x.name))
+    else:
+        eprint("don't know how to handle: {}".format(x))
+        assert(0)
 
-    for x in ast:
-        eprint("begin loop")
-        eprint(x)
-        if isinstance(x, pycparser.c_ast.FuncDef):
-            continue
-        elif isinstance(x, pycparser.c_ast.Decl):
-            s = gen_decl(x)
+    dprint("end loop")
+
+    return s
+
+# pycparser does not know GCC attributes, so attributes with packed in their
+# list are removed from the preprocessed input as a whole (replaced with
+# spaces, keeping the coordinates) and the tags of the structs they were
+# applied to are returned, e.g. for
+#
+#     struct foo { ... } __attribute__((__packed__));
+#     struct __attribute__((packed, aligned(4))) bar { ... };
+attr_re = re.compile(r'__attribute(?:__)?\s*\(\(((?:[^()]|\((?:[^()]|\([^()]*\))*\))*)\)\)')
+packed_re = re.compile(r'\b(?:__packed__|packed)\b')
+struct_tag_after_re = re.compile(r'\s*(\w+)')
+struct_tag_before_re = re.compile(r'struct\s+(\w+)\s*$')
+
+def strip_packed_attributes(text):
+    tags = set()
+
+    packed = [m for m in attr_re.finditer(text) if packed_re.search(m.group(1))]
+    for m in packed:
+        before = text[:m.start()].rstrip()
+        if before.endswith("struct"):
+            t = struct_tag_after_re.match(text, m.end())
+            if t:
+                tags.add(t.group(1))
+        elif before.endswith("}"):
+            # find the opening brace of the struct body
+            depth = 0
+            for i in range(len(before) - 1, -1, -1):
+                if before[i] == "}":
+                    depth += 1
+                elif before[i] == "{":
+                    depth -= 1
+                    if depth == 0:
+                        t = struct_tag_before_re.search(before, 0, i)
+                        if t:
+                            tags.add(t.group(1))
+                        break
+
+    for m in reversed(packed):
+        text = text[:m.start()] + " " * (m.end() - m.start()) + text[m.end():]
+
+    return text, tags
+
+# DWARF front-end (--dwarf)
+#
+# Reads the type information of an object file built with -g (and
+# -fno-eliminate-unused-debug-types, so that unused types are kept) from the
+# output of readelf, instead of parsing a preprocessed header. It produces the
+# same descriptors as gen_struct() and gen_enum(), plus the byte offset and
+# size of every member ("offset", "size", relative to the enclosing struct or
+# anonymous struct) and the bit position of bit-fields ("bit_offset" from the
+# start of the enclosing struct, "bit_size"). Structs also get their "size".
+
+dwarf_die_re = re.compile(r"^\s*<(\d+)><([0-9a-f]+)>: Abbrev Number: (\d+)(?: \((DW_TAG_\w+)\))?")
+dwarf_attr_re = re.compile(r"^\s*<[0-9a-f]+>\s+(DW_AT_\w+)\s*:\s?(.*)$")
+# newer readelf prefixes values with their form, e.g. "(data1) 4"
+dwarf_form_re = re.compile(r"^\(\w+\) ")
+dwarf_ref_re = re.compile(r"^<0x([0-9a-f]+)>")
+dwarf_plus_uconst_re = re.compile(r"DW_OP_plus_uconst: (\d+)")
+
+# GCC's names of the base types that have a printf format of their own
+dwarf_base_type_names = {
+    "int": "int",
+    "char": "char",
+    "unsigned int": "unsigned",
+    "long int": "long",
+    "long unsigned int": "unsigned long",
+    "long long int": "long long",
+    "long long unsigned int": "unsigned long long",
+    "_Bool": "_Bool",
+}
+
+class DwarfDie:
+    def __init__(self, offset, tag):
+        self.offset = offset
+        self.tag = tag
+        self.attrs = {}
+        self.children = []
+
+    def name(self):
+        value = self.attrs.get("DW_AT_name")
+        if value is None:
+            return None
+        # strings may be printed as "(indirect string, offset: 0x12): name"
+        # or "(offset: 0x12): name"
+        if value.startswith("(") and "): " in value:
+            value = value.split("): ", 1)[1]
+        return value.strip()
+
+    def ref(self, attr):
+        m = dwarf_ref_re.match(self.attrs.get(attr, ""))
+        return int(m.group(1), 16) if m else None
+
+    def num(self, attr, default=None):
+        value = self.attrs.get(attr)
+        if value is None:
+            return default
+        if "DW_OP_plus_uconst" in value:
+            # DWARF 2 member locations are expressions
+            return int(dwarf_plus_uconst_re.search(value).group(1))
+        return int(value.split(None, 1)[0], 0)
+
+class DwarfReader:
+    def __init__(self, path):
+        try:
+            text = subprocess.run(["readelf", "--wide", "-h", "--debug-dump=info", path],
+                check=True, capture_output=True, text=True).stdout
+        except (OSError, subprocess.CalledProcessError) as e:
+            eprint("error: can not read debug info of {}: {}".format(path, e))
+            sys.exit(1)
+
+        self.little_endian = "little endian" in text.split("Contents of the .debug_info section", 1)[0]
+        self.dies = {}
+        self.sizes = {}
+
+        stack = []
+        die = None
+        for line in text.splitlines():
+            m = dwarf_die_re.match(line)
+            if m:
+                depth = int(m.group(1))
+                del stack[depth:]
+                die = None
+                if m.group(3) == "0":
+                    # end of the children of the previous level
+                    continue
+
+                die = DwarfDie(int(m.group(2), 16), m.group(4))
+                self.dies[die.offset] = die
+                if stack:
+                    stack[-1].children.append(die)
+                stack.append(die)
+                continue
+
+            m = dwarf_attr_re.match(line)
+            if m and die is not None:
+                die.attrs[m.group(1)] = dwarf_form_re.sub("", m.group(2))
+
+    def type_die(self, die):
+        offset = die.ref("DW_AT_type")
+        return None if offset is None else self.dies.get(offset)
+
+    def type_size(self, die):
+        if die is None:
+            return 0
+        if die.offset not in self.sizes:
+            self.sizes[die.offset] = self.compute_type_size(die)
+        return self.sizes[die.offset]
+
+    def compute_type_size(self, die):
+        while die is not None:
+            if die.tag == "DW_TAG_array_type":
+                size = self.type_size(self.type_die(die))
+                for dim in self.array_dims(die):
+                    size *= dim or 0
+                return size
+            if "DW_AT_byte_size" in die.attrs:
+                return die.num("DW_AT_byte_size")
+            die = self.type_die(die)
+
+        return 0
+
+    def array_dims(self, die):
+        dims = []
+        for sub in die.children:
+            if sub.tag != "DW_TAG_subrange_type":
+                continue
+            if "DW_AT_count" in sub.attrs:
+                dims.append(sub.num("DW_AT_count"))
+            elif "DW_AT_upper_bound" in sub.attrs:
+                dims.append(sub.num("DW_AT_upper_bound") + 1)
+            else:
+                # flexible array member
+                dims.append(None)
+        return dims
+
+    # Returns the descriptor of the type of a member (without name) and its
+    # array dimensions, or None when it can not be printed
+    def member_type(self, die):
+        dims = []
+        t = self.type_die(die)
+
+        while t is not None:
+            if t.tag in ("DW_TAG_const_type", "DW_TAG_volatile_type", "DW_TAG_atomic_type"):
+                t = self.type_die(t)
+            elif t.tag == "DW_TAG_typedef":
+                # keep typedef names with a format of their own, e.g. uint32_t
+                name = t.name()
+                if stdint_type_re.fullmatch(name) or name in type_to_fmt_str:
+                    return {"type": name}, dims
+                t = self.type_die(t)
+            elif t.tag == "DW_TAG_array_type":
+                dims.extend(self.array_dims(t))
+                t = self.type_die(t)
+            elif t.tag == "DW_TAG_base_type":
+                return {"type": self.base_type_name(t)}, dims
+            elif t.tag == "DW_TAG_structure_type":
+                if t.name() is None:
+                    return self.gen_struct(t), dims
+                # reference, resolved through the type registry like
+                # "struct foo x;"
+                return {"type": "struct " + t.name(), "children": [], "defined": False}, dims
+            elif t.tag == "DW_TAG_enumeration_type" and t.name() is not None:
+                return {"type": "enum " + t.name()}, dims
+            else:
+                dprint("skipping member of type {}".format(t.tag))
+                return None, dims
+
+        return None, dims
+
+    def base_type_name(self, die):
+        name = die.name()
+        if name in dwarf_base_type_names:
+            return dwarf_base_type_names[name]
+
+        encoding = die.attrs.get("DW_AT_encoding", "")
+        size = die.num("DW_AT_byte_size")
+        if "float" in encoding:
+            return name
+        if "unsigned" in encoding or "boolean" in encoding:
+            return "uint{}_t".format(size * 8)
+        return "int{}_t".format(size * 8)
+
+    def gen_struct(self, die):
+        r = {
+            "type": "struct " if die.name() is None else "struct " + die.name(),
+            "children": [],
+            "defined": True,
+            "size": self.type_size(die),
+        }
+
+        for m in die.children:
+            if m.tag != "DW_TAG_member":
+                continue
+
+            child, dims = self.member_type(m)
+            if child is None:
+                continue
+
+            child = dict(child)
+            child["name"] = m.name()
+            if dims:
+                child["array_len"] = [None if dim is None else str(dim) for dim in dims]
+            child["size"] = self.type_size(self.type_die(m))
+
+            if "DW_AT_bit_size" in m.attrs:
+                bit_size = m.num("DW_AT_bit_size")
+                if "DW_AT_data_bit_offset" in m.attrs:
+                    bit_offset = m.num("DW_AT_data_bit_offset")
+                else:
+                    # DWARF 2/3 count DW_AT_bit_offset from the most
+                    # significant bit of the storage unit
+                    storage = m.num("DW_AT_byte_size", child["size"])
+                    bit_offset = m.num("DW_AT_data_member_location", 0) * 8
+                    if self.little_endian:
+                        bit_offset += storage * 8 - m.num("DW_AT_bit_offset") - bit_size
+                    else:
+                        bit_offset += m.num("DW_AT_bit_offset")
+                child["offset"] = bit_offset // 8
+                child["bit_offset"] = bit_offset
+                child["bit_size"] = bit_size
+            else:
+                child["offset"] = m.num("DW_AT_data_member_location", 0)
+                # packed structs are not marked in the debug info, but have
+                # members at offsets their alignment does not allow
+                elem_size = child["size"]
+                for dim in dims:
+                    elem_size = elem_size // int(dim) if dim else 0
+                if elem_size in (2, 4, 8) and "children" not in child and child["offset"] % elem_size:
+                    r["packed"] = True
+
+            r["children"].append(child)
+
+        return r
+
+    def gen_enum(self, die):
+        return {
+            "type": "enum " + die.name(),
+            "values": [(v.name(), v.num("DW_AT_const_value")) for v in die.children if v.tag == "DW_TAG_enumerator"],
+        }
+
+    # Returns the descriptors of all named struct and enum definitions, the
+    # first one of each name when several compilation units define it
+    def descriptors(self):
+        result = []
+        seen = set()
+
+        for die in self.dies.values():
+            if die.tag not in ("DW_TAG_structure_type", "DW_TAG_enumeration_type"):
+                continue
+            if die.name() is None or "DW_AT_declaration" in die.attrs:
+                continue
+
+            if die.tag == "DW_TAG_structure_type":
+                s = self.gen_struct(die)
+            else:
+                s = self.gen_enum(die)
+
+            if s["type"] in seen:
+                continue
+            seen.add(s["type"])
+
+            s["name"] = None
+            result.append(s)
+
+        return result
+
+# Incremental regeneration (--cache)
+#
+# The preprocessed input is split into its top level declarations and the
+# parsed descriptors are cached per declaration, keyed by a hash of its text,
+# so that only new or changed declarations go through pycparser. Generated
+# enum and struct functions are cached keyed by a hash of their descriptor.
+# When neither the input, the generator nor its options changed, the output
+# is not touched at all.
+
+CACHE_VERSION = 2
+
+decl_split_re = re.compile(r'"(?:\\.|[^"\\\n])*"|\'(?:\\.|[^\'\\\n])*\'|^#[^\n]*|[{}();]', re.MULTILINE)
+
+# Split preprocessed C into its top level declarations (and function
+# definitions), with line markers removed.
+def split_top_level_decls(text):
+    decls = []
+    depth = 0
+    start = 0
+    func_body = False
+
+    for m in decl_split_re.finditer(text):
+        tok = m.group(0)
+        end = None
+
+        if tok == "{" or tok == "(":
+            if depth == 0 and tok == "{":
+                # function bodies directly follow the declarator's ")"
+                i = m.start() - 1
+                while i >= start and text[i].isspace():
+                    i -= 1
+                func_body = i >= start and text[i] == ")"
+            depth += 1
+        elif tok == "}" or tok == ")":
+            depth -= 1
+            if depth == 0 and func_body:
+                func_body = False
+                end = m.end()
+        elif tok == ";" and depth == 0:
+            end = m.end()
+
+        if end is not None:
+            decls.append(text[start:end])
+            start = end
+
+    decls.append(text[start:])
+
+    decls = ["\n".join(l for l in d.split("\n") if not l.startswith("#")).strip() for d in decls]
+
+    return [d for d in decls if d]
+
+def decl_is_typedef(decl):
+    return decl.split(None, 1)[0] == "typedef"
+
+def hash_str(s):
+    return hashlib.sha1(s.encode()).hexdigest()
+
+def hash_descriptor(item):
+    return hash_str(json.dumps(item, sort_keys=True))
+
+class RegenCache:
+    def __init__(self, path, generator_id):
+        self.path = path
+        self.generator_id = generator_id
+
+        data = {}
+        try:
+            with open(path) as f:
+                data = json.load(f)
+        except (OSError, ValueError):
+            pass
+
+        if data.get("version") != CACHE_VERSION:
+            data = {}
+
+        self.prev_input = data.get("input")
+        self.prev_outputs = data.get("outputs", {})
+        self.prev_generator = data.get("generator")
+        self.prev_decls = data.get("decls", {})
+        # generated code is only valid for the same generator and options
+        self.prev_code = data.get("code", {}) if self.prev_generator == generator_id else {}
+
+        # entries used by this run, only these are saved
+        self.decls = {}
+        self.code = {}
+        self.code_start = None
+        self.num_parsed = 0
+        self.num_generated = 0
+
+    def up_to_date(self, input_hash, output_paths):
+        if self.prev_input != input_hash or self.prev_generator != self.generator_id:
+            return False
+
+        if sorted(output_paths) != sorted(self.prev_outputs):
+            return False
+
+        for path in output_paths:
+            try:
+                with open(path) as f:
+                    if hash_str(f.read()) != self.prev_outputs[path]:
+                        return False
+            except OSError:
+                return False
+
+        return True
+
+    def parse(self, text):
+        decls = split_top_level_decls(text)
+        hashes = [hash_str(d) for d in decls]
+        todo = set(i for i, d in enumerate(decls) if not decl_is_typedef(d) and hashes[i] not in self.prev_decls)
+
+        parsed = {}
+        if todo:
+            # Typedef names have to be known to the parser, so all typedefs are
+            # parsed along with the changed declarations. The line markers map
+            # the parsed declarations back to their index.
+            parts = []
+            for i, d in enumerate(decls):
+                if i in todo or decl_is_typedef(d):
+                    parts.append('# 1 "decl:{}"\n{}\n'.format(i, d))
+
+            ast = pycparser.c_parser.CParser().parse("".join(parts), "decls")
+
+            parsed = {i: [] for i in todo}
+            for x in ast:
+                idx = int(x.coord.file.split(":")[1])
+                s = gen_ext_decl(x)
+                if s is not None and idx in parsed:
+                    parsed[idx].append(s)
+
+            self.num_parsed = len(todo)
+
+        result = []
+        for i, d in enumerate(decls):
+            if decl_is_typedef(d):
+                continue
+
+            descs = parsed[i] if i in parsed else self.prev_decls[hashes[i]]
+            self.decls[hashes[i]] = descs
+            result.extend(descs)
+
+        return result
+
+    # Emit the cached code for item, returns False if it has to be generated
+    def emit_code(self, item):
+        key = hash_descriptor(item)
+        lines = self.code.get(key, self.prev_code.get(key))
+
+        if lines is None:
+            self.code_start = len(out_lines)
+            return False
+
+        out_lines.extend(lines)
+        self.code[key] = lines
+
+        return True
+
+    # Store the code generated for item since emit_code() returned False
+    def store_code(self, item):
+        self.code[hash_descriptor(item)] = out_lines[self.code_start:]
+        self.num_generated += 1
+
+    def save(self, input_hash, outputs):
+        data = {
+            "version": CACHE_VERSION,
+            "generator": self.generator_id,
+            "input": input_hash,
+            "outputs": {path: hash_str(text) for path, text in outputs.items()},
+            "decls": self.decls,
+            "code": self.code,
+        }
+
+        tmp = self.path + ".tmp"
+        with open(tmp, "w") as f:
+            # json.dumps() uses the C encoder, json.dump() does not
+            f.write(json.dumps(data))
+        os.replace(tmp, self.path)
+
+# Identifies the generator and every option affecting the generated code
+def get_generator_id(args):
+    with open(os.path.abspath(__file__), "rb") as f:
+        h = hashlib.sha1(f.read())
+
+    opts = {k: v for k, v in vars(args).items() if k not in ("input", "output", "cache", "debug")}
+    h.update(json.dumps(opts, sort_keys=True).encode())
+
+    return h.hexdigest()
+
+# Only write the file when its contents change, so make does not rebuild what
+# depends on it.
+def write_if_changed(path, text):
+    try:
+        with open(path) as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+
+    with open(path, "w") as f:
+        f.write(text)
+
+def main():
+    global debug
+
+    parser = argparse.ArgumentParser(description="Generate C code printing the structures of a preprocessed C header as JSON")
+    parser.add_argument("input", help="preprocessed C header, or object file with --dwarf")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    parser.add_argument("-d", "--debug", action="store_true", help="trace parsing and dump the parsed structures to stderr")
+    parser.add_argument("--cache", metavar="FILE", help="cache of parsed declarations and generated code for incremental regeneration")
+    parser.add_argument("--split", type=int, metavar="N", help="write a header (the -o file) and N translation units <header stem>_<i>.c")
+    parser.add_argument("--include", action="append", default=[], metavar="HEADER", help="header the split output includes (the input header)")
+    parser.add_argument("--root", action="append", metavar="STRUCT", help="only generate this struct and what it references (may be repeated)")
+    parser.add_argument("--byte-order", choices=("native", "little", "big"), default="native", help="byte order of the members of all structs")
+    parser.add_argument("--struct-byte-order", action="append", default=[], metavar="STRUCT=ORDER", help="byte order of the members of one struct (may be repeated)")
+    parser.add_argument("--unaligned", action="store_true", help="generate dumpers for structs at any alignment, as for packed structs")
+    parser.add_argument("--no-dedup", action="store_true", help="do not share the implementation of structs of the same shape")
+    parser.add_argument("--dwarf", action="store_true", help="read the types from the debug info of an object file built with -g")
+    parser.add_argument("--cxx", action="store_true", help="generate a C++ header with constexpr descriptors for json_reflect.hpp instead")
+    parser.add_argument("--openmetrics", action="store_true", help="also generate dump_openmetrics_struct_<name>() functions")
+    parser.add_argument("--csv", action="store_true", help="also generate dump_csv_header_<name>() and dump_csv_rows_<name>() functions")
+    parser.add_argument("--positional", action="store_true", help="also generate dump_json_schema_<name>() and dump_json_records_<name>() functions")
+    args = parser.parse_args()
+
+    debug = args.debug
+
+    if args.cxx and (args.openmetrics or args.csv or args.positional):
+        parser.error("--openmetrics, --csv and --positional can not be used with --cxx")
+
+    split = None
+    output_paths = [args.output] if args.output else []
+    if args.split is not None:
+        if args.cxx:
+            parser.error("--split can not be used with --cxx")
+        if args.split < 1 or not args.output:
+            parser.error("--split needs a positive number of shards and -o")
+        split = (args.split, args.output, args.include)
+        stem = os.path.splitext(args.output)[0]
+        output_paths += ["{}_{}.c".format(stem, i) for i in range(args.split)]
+
+    if not args.dwarf:
+        with open(args.input) as f:
+            text = f.read()
+
+    cache = None
+    if args.cache:
+        if args.dwarf:
+            with open(args.input, "rb") as f:
+                input_hash = hashlib.sha1(f.read()).hexdigest()
+        else:
+            input_hash = hash_str(text)
+
+        cache = RegenCache(args.cache, get_generator_id(args))
+        if output_paths and cache.up_to_date(input_hash, output_paths):
+            dprint("{} is up to date".format(", ".join(output_paths)))
+            return
+
+    packed_tags = set()
+    if not args.dwarf:
+        text, packed_tags = strip_packed_attributes(text)
+
+    if args.dwarf:
+        # only the generated code is cached, the debug info is read quickly
+        result = DwarfReader(args.input).descriptors()
+    elif cache:
+        result = cache.parse(text)
+    else:
+        ast = pycparser.c_parser.CParser().parse(text, args.input)
+
+        result = []
+        for x in ast:
+            s = gen_ext_decl(x)
             if s is not None:
                 result.append(s)
-        elif isinstance(x, pycparser.c_ast.Typedef):
-            eprint("skipping typedef {}".format(x.name))
-        else:
-            eprint("don't know how to handle: {}".format(x))
-            assert(0)
-        eprint("end loop")
 
-    pp = pprint.PrettyPrinter(stream=sys.stderr)
-    pp.pprint(result)
+    if not args.dwarf:
+        # cached descriptors may have been marked by an earlier run
+        for item in result:
+            item.pop("packed", None)
+            if item["type"].startswith("struct ") and item["type"].split("struct ")[1] in packed_tags:
+                item["packed"] = True
+
+    if debug:
+        pp = pprint.PrettyPrinter(stream=sys.stderr)
+        pp.pprint(result)
+
+    byte_orders = {"*": args.byte_order}
+    for opt in args.struct_byte_order:
+        name, _, order = opt.partition("=")
+        if order not in ("native", "little", "big"):
+            parser.error("--struct-byte-order needs STRUCT=native|little|big, not {}".format(opt))
+        byte_orders[name] = order
+
+    if args.cxx:
+        files = [capture(generate_cxx_reflection, result, args.output, args.include, args.root)]
+    else:
+        files = generate_c_json_prints(result, cache, split, args.root, not args.no_dedup, byte_orders, args.unaligned, args.openmetrics, args.csv,
+            args.positional)
+
+    outputs = {}
+    if output_paths:
+        for path, lines in zip(output_paths, files):
+            outputs[path] = "\n".join(lines) + "\n"
+            write_if_changed(path, outputs[path])
+    else:
+        sys.stdout.write("\n".join(files[0]) + "\n")
 
-    generate_c_json_prints(result)
+    if cache:
+        dprint("parsed {} declarations, generated {} functions".format(cache.num_parsed, cache.num_generated))
+        cache.save(input_hash, outputs)
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,100 @@
+#!/bin/env python3
+#
+# Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+#
+# Permission to use, copy, modify, and distribute this software for
+# any purpose with or without fee is hereby granted, provided that
+# the above copyright notice and this permission notice appear in all
+# copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+# DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+# OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+# TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Check CSV (or with -t, TSV) written by the dump_csv_header_<name>() and
+# dump_csv_rows_<name>() functions (--csv): a header of unique column names,
+# rows of numbers of the same length. With --json FILE KEY, the first row has
+# to match the struct dumped as KEY in the JSON file, whose members are
+# flattened into the same column names. With --expect ROW:COLUMN=VALUE, the
+# value is checked.
+
+import sys
+import csv
+import json
+import argparse
+
+# Flatten a dumped struct into column names, e.g. grid[1][2] or a.b
+def flatten(value, name, out):
+    if isinstance(value, dict):
+        for k, v in value.items():
+            flatten(v, "{}.{}".format(name, k) if name else k, out)
+    elif isinstance(value, list):
+        for i, v in enumerate(value):
+            flatten(v, "{}[{}]".format(name, i), out)
+    else:
+        out[name] = value
+
+    return out
+
+def check(args):
+    with open(args.file, newline="") as f:
+        rows = list(csv.reader(f, delimiter="\t" if args.t else ","))
+
+    if not rows:
+        return "no header"
+
+    header = rows[0]
+    if len(set(header)) != len(header):
+        return "duplicate column names"
+
+    for num, row in enumerate(rows[1:], 1):
+        if len(row) != len(header):
+            return "row {}: {} values for {} columns".format(num, len(row), len(header))
+        for v in row:
+            try:
+                float(v)
+            except ValueError:
+                return "row {}: not a number: {}".format(num, v)
+
+    if args.json:
+        path, key = args.json
+        with open(path) as f:
+            expected = flatten(json.load(f)[key], "", {})
+        if len(rows) < 2:
+            return "no rows"
+        for col, v in zip(header, rows[1]):
+            if col not in expected:
+                return "column {} is not in {}".format(col, path)
+            if float(v) != float(expected[col]):
+                return "column {}: {} is not {}".format(col, v, expected[col])
+
+    for e in args.expect:
+        pos, _, value = e.partition("=")
+        num, _, col = pos.partition(":")
+        if col not in header or int(num) + 1 >= len(rows):
+            return "no value at {}".format(pos)
+        if float(rows[int(num) + 1][header.index(col)]) != float(value):
+            return "{} is not {}".format(pos, value)
+
+    return None
+
+def main():
+    parser = argparse.ArgumentParser(description="Check CSV written by the generated code")
+    parser.add_argument("file")
+    parser.add_argument("-t", action="store_true", help="tab separated")
+    parser.add_argument("--json", nargs=2, metavar=("FILE", "KEY"), help="compare the first row with a JSON dump")
+    parser.add_argument("--expect", action="append", default=[], metavar="ROW:COLUMN=VALUE", help="expected value")
+    args = parser.parse_args()
+
+    error = check(args)
+    if error:
+        sys.exit("{}: {}".format(args.file, error))
+
+if __name__ == '__main__':
+    main()
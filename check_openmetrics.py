@@ -0,0 +1,97 @@
+#!/bin/env python3
+#
+# Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+#
+# Permission to use, copy, modify, and distribute this software for
+# any purpose with or without fee is hereby granted, provided that
+# the above copyright notice and this permission notice appear in all
+# copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+# DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+# OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+# TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Check that a file is well-formed OpenMetrics text, as printed by the
+# dump_openmetrics_struct_<name>() functions (--openmetrics): every family is
+# declared once with # TYPE before its samples, which are contiguous, sample
+# names and labels fit the family type, and the exposition ends with # EOF.
+
+import re
+import sys
+
+name_re = r"[a-zA-Z_:][a-zA-Z0-9_:]*"
+type_re = re.compile(r"# TYPE ({}) (counter|gauge|stateset|unknown)$".format(name_re))
+sample_re = re.compile(r"({})(?:\{{(.*)\}})? (\S+)$".format(name_re))
+label_re = re.compile(r'([a-zA-Z_][a-zA-Z0-9_]*)="((?:[^"\\\n]|\\[\\"n])*)"')
+
+def parse_labels(text):
+    labels = {}
+    pos = 0
+    while pos < len(text):
+        m = label_re.match(text, pos)
+        if not m or m.group(1).startswith("__") or m.group(1) in labels:
+            return None
+        labels[m.group(1)] = m.group(2)
+        pos = m.end()
+        if pos < len(text):
+            if text[pos] != ",":
+                return None
+            pos += 1
+
+    return labels
+
+def check(lines):
+    families = {}
+    cur = None
+
+    if not lines or lines[-1] != "# EOF":
+        return "missing # EOF at the end"
+
+    for num, line in enumerate(lines[:-1], 1):
+        m = type_re.match(line)
+        if m:
+            if m.group(1) in families:
+                return "line {}: family {} declared twice".format(num, m.group(1))
+            cur = m.group(1)
+            families[cur] = m.group(2)
+            continue
+
+        m = sample_re.match(line)
+        if not m or cur is None:
+            return "line {}: not a sample: {}".format(num, line)
+
+        name, labels, value = m.group(1), parse_labels(m.group(2) or ""), m.group(3)
+        expected = cur + "_total" if families[cur] == "counter" else cur
+        if name != expected:
+            return "line {}: sample {} is not in family {}".format(num, name, cur)
+        if labels is None:
+            return "line {}: bad labels: {}".format(num, line)
+        if families[cur] == "stateset" and (cur not in labels or value not in ("0", "1")):
+            return "line {}: bad stateset sample: {}".format(num, line)
+        try:
+            float(value)
+        except ValueError:
+            return "line {}: bad value: {}".format(num, value)
+        if families[cur] == "counter" and float(value) < 0:
+            return "line {}: negative counter: {}".format(num, line)
+
+    return None
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: {} file".format(sys.argv[0]))
+
+    with open(sys.argv[1]) as f:
+        error = check(f.read().split("\n")[:-1])
+
+    if error:
+        sys.exit("{}: {}".format(sys.argv[1], error))
+
+if __name__ == '__main__':
+    main()
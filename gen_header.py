@@ -0,0 +1,161 @@
+#!/bin/env python3
+#
+# Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+#
+# Permission to use, copy, modify, and distribute this software for
+# any purpose with or without fee is hereby granted, provided that
+# the above copyright notice and this permission notice appear in all
+# copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+# DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+# OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+# TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Synthesize C headers for scaling benchmarks of c_header_to_json.py and the
+# code it generates. The output is deterministic for a given set of arguments.
+
+import sys
+import argparse
+import random
+
+scalar_types = [
+    "uint8_t", "uint16_t", "uint32_t", "uint64_t",
+    "int8_t", "int16_t", "int32_t", "int64_t",
+    "int", "unsigned", "long",
+]
+
+class HeaderGen:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.lines = []
+        # (name, reference depth) of every top level struct
+        self.structs = []
+        self.enums = []
+        self.field_idx = 0
+        self.ref_targets = []
+        self.cur_ref_depth = 0
+
+    def emit(self, indent, line):
+        self.lines.append("    " * indent + line)
+
+    def field_name(self):
+        self.field_idx += 1
+        return "f{}".format(self.field_idx)
+
+    def array_suffix(self):
+        a = self.args
+        if a.array_rank == 0 or self.rng.random() >= a.array_ratio:
+            return ""
+
+        rank = self.rng.randint(1, a.array_rank)
+        return "".join("[{}]".format(self.rng.randint(1, a.array_dim)) for _ in range(rank))
+
+    def gen_enum(self, idx):
+        name = "gen_enum_{}".format(idx)
+        self.emit(0, "enum {} {{".format(name))
+        for v in range(self.args.enum_values):
+            self.emit(1, "GEN_ENUM_{}_V{},".format(idx, v))
+        self.emit(0, "};")
+        self.emit(0, "")
+        self.enums.append(name)
+
+    def gen_fields(self, indent, depth):
+        a = self.args
+        for _ in range(a.fields):
+            r = self.rng.random()
+            if depth < a.depth and r < a.nested_ratio:
+                self.gen_inline_struct(indent, depth + 1)
+            elif self.ref_targets and r < a.nested_ratio + a.ref_ratio:
+                # reference to a previously defined (tagged) struct
+                name, ref_depth = self.rng.choice(self.ref_targets)
+                self.cur_ref_depth = max(self.cur_ref_depth, ref_depth + 1)
+                self.emit(indent, "struct {} {};".format(name, self.field_name()))
+            elif self.enums and r < a.nested_ratio + a.ref_ratio + a.enum_ratio:
+                self.emit(indent, "enum {} {};".format(self.rng.choice(self.enums), self.field_name()))
+            else:
+                self.emit(indent, "{} {}{};".format(self.rng.choice(scalar_types), self.field_name(), self.array_suffix()))
+
+    # Nested struct definitions are a mix of anonymous (untagged) structs,
+    # untagged structs with a name and tagged structs with a name.
+    def gen_inline_struct(self, indent, depth):
+        anonymous = self.rng.random() < self.args.anon_ratio
+        tagged = not anonymous and self.rng.random() < 0.5
+
+        if tagged:
+            tag = "gen_inner_{}".format(self.field_name())
+            self.emit(indent, "struct {} {{".format(tag))
+        else:
+            self.emit(indent, "struct {")
+
+        self.gen_fields(indent + 1, depth)
+
+        if anonymous:
+            self.emit(indent, "};")
+        else:
+            self.emit(indent, "}} {};".format(self.field_name()))
+
+    def gen_struct(self, idx):
+        name = "gen_struct_{}".format(idx)
+        # Only reference structs that are not too deep themselves, otherwise
+        # the size of a dump grows exponentially with the number of structs.
+        self.ref_targets = [x for x in self.structs if x[1] < self.args.ref_depth]
+        self.cur_ref_depth = 0
+        self.emit(0, "struct {} {{".format(name))
+        self.gen_fields(1, 0)
+        self.emit(0, "};")
+        self.emit(0, "")
+        self.structs.append((name, self.cur_ref_depth))
+
+    def generate(self):
+        a = self.args
+        self.emit(0, "#include <stdint.h>")
+        self.emit(0, "")
+        for i in range(a.enums):
+            self.gen_enum(i)
+        for i in range(a.structs):
+            self.gen_struct(i)
+
+        return "\n".join(self.lines) + "\n"
+
+def add_arguments(parser):
+    parser.add_argument("--structs", type=int, default=100, help="number of top level structs")
+    parser.add_argument("--fields", type=int, default=16, help="fields per struct (and per nested struct)")
+    parser.add_argument("--depth", type=int, default=1, help="maximum nesting depth of inline struct definitions")
+    parser.add_argument("--array-rank", type=int, default=2, help="maximum array rank (0 disables arrays)")
+    parser.add_argument("--array-dim", type=int, default=8, help="maximum size of each array dimension")
+    parser.add_argument("--array-ratio", type=float, default=0.25, help="fraction of scalar fields that are arrays")
+    parser.add_argument("--nested-ratio", type=float, default=0.05, help="fraction of fields that are inline struct definitions")
+    parser.add_argument("--ref-ratio", type=float, default=0.05, help="fraction of fields referencing an earlier struct")
+    parser.add_argument("--ref-depth", type=int, default=2, help="maximum depth of chains of struct references")
+    parser.add_argument("--anon-ratio", type=float, default=0.5, help="fraction of inline structs that are anonymous")
+    parser.add_argument("--enums", type=int, default=4, help="number of enums")
+    parser.add_argument("--enum-values", type=int, default=16, help="values per enum")
+    parser.add_argument("--enum-ratio", type=float, default=0.05, help="fraction of fields that are enums")
+    parser.add_argument("--seed", type=int, default=1, help="random seed")
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a synthetic C header")
+    add_arguments(parser)
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    if args.enums and args.enum_values < 1:
+        parser.error("--enum-values must be at least 1")
+
+    text = HeaderGen(args).generate()
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Buffers move between two bounded lock-free queues (Dmitry Vyukov's MPMC
+// array queue): free buffers, and full buffers waiting for the writer thread.
+// A semaphore counts each queue's entries, for the writer thread to sleep on
+// and for JSON_ASYNC_BLOCK to wait for a free buffer.
+//
+// The drop policies drop whole documents, so that what is written still
+// parses: a thread chains the buffers of its current document and queues the
+// chain on json_async_commit(), and when it runs out of buffers it drops the
+// chain and the rest of the document.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "json_async.h"
+
+struct async_buf {
+    // the next buffer of the same document
+    struct async_buf *next;
+    size_t len;
+    char data[];
+};
+
+struct queue_cell {
+    atomic_size_t seq;
+    struct async_buf *buf;
+};
+
+struct queue {
+    struct queue_cell *cells;
+    size_t mask;
+    // producers and consumers on separate cache lines
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+};
+
+static struct {
+    int fd;
+    size_t buf_size;
+    size_t num_bufs;
+    enum json_async_policy policy;
+    struct async_buf **bufs;
+    struct queue free_q;
+    struct queue full_q;
+    sem_t free_sem;
+    sem_t full_sem;
+    atomic_bool stopping;
+    pthread_t thread;
+    atomic_uint_fast64_t bytes_dropped;
+    atomic_uint_fast64_t buffers_dropped;
+    // only touched by the writer thread
+    uint64_t bytes_written;
+    uint64_t buffers_written;
+    int write_error;
+} g_async;
+
+// The first and last buffer of the calling thread's document, and whether
+// the rest of the document is dropped
+static __thread struct async_buf *t_head;
+static __thread struct async_buf *t_buf;
+static __thread bool t_dropping;
+
+static int queue_init(struct queue *q, size_t n)
+{
+    size_t size = 1;
+
+    while (size < n) {
+        size <<= 1;
+    }
+
+    q->cells = calloc(size, sizeof(*q->cells));
+    if (!q->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        atomic_init(&q->cells[i].seq, i);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+
+    return 0;
+}
+
+// Never fails, the queues have room for all buffers
+static void queue_push(struct queue *q, struct async_buf *buf)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    struct queue_cell *c;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The queue holds all buffers at most, but a consumer that was
+            // preempted between taking the entry of this cell one lap ago and
+            // releasing the cell holds it for a moment
+            sched_yield();
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    c->buf = buf;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+}
+
+static struct async_buf *queue_pop(struct queue *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    struct queue_cell *c;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    struct async_buf *buf = c->buf;
+    atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+
+    return buf;
+}
+
+static void sem_wait_intr(sem_t *s)
+{
+    while (sem_wait(s) != 0) {
+        assert(errno == EINTR);
+    }
+}
+
+static void drop(struct async_buf *buf)
+{
+    atomic_fetch_add_explicit(&g_async.bytes_dropped, buf->len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_async.buffers_dropped, 1, memory_order_relaxed);
+    buf->len = 0;
+}
+
+// Return the buffers of a chain after buf to the free queue
+static void free_rest(struct async_buf *buf)
+{
+    struct async_buf *next = buf->next;
+
+    buf->next = NULL;
+    while (next) {
+        buf = next;
+        next = buf->next;
+        buf->next = NULL;
+        queue_push(&g_async.free_q, buf);
+        sem_post(&g_async.free_sem);
+    }
+}
+
+// An empty buffer for the calling thread, or NULL when the policy drops the
+// newest output instead
+static struct async_buf *get_free_buf(void)
+{
+    if (g_async.policy == JSON_ASYNC_BLOCK) {
+        sem_wait_intr(&g_async.free_sem);
+    } else if (sem_trywait(&g_async.free_sem) != 0) {
+        if (g_async.policy == JSON_ASYNC_DROP_OLDEST) {
+            // The writer thread may wake up once more than there are
+            // documents to write, and finds the queue empty.
+            struct async_buf *buf = queue_pop(&g_async.full_q);
+            if (buf) {
+                for (struct async_buf *b = buf; b; b = b->next) {
+                    drop(b);
+                }
+                free_rest(buf);
+                return buf;
+            }
+        }
+        return NULL;
+    }
+
+    struct async_buf *buf = queue_pop(&g_async.free_q);
+    assert(buf);
+    buf->len = 0;
+
+    return buf;
+}
+
+// Drop the calling thread's document, up to the next json_async_commit()
+static void drop_document(void)
+{
+    if (t_head) {
+        for (struct async_buf *b = t_head; b; b = b->next) {
+            drop(b);
+        }
+        free_rest(t_head);
+        queue_push(&g_async.free_q, t_head);
+        sem_post(&g_async.free_sem);
+    }
+    t_head = NULL;
+    t_buf = NULL;
+    t_dropping = true;
+}
+
+static void write_all(const char *p, size_t n)
+{
+    while (n && !g_async.write_error) {
+        ssize_t r = write(g_async.fd, p, n);
+        if (r < 0) {
+            if (errno != EINTR) {
+                g_async.write_error = errno;
+            }
+            continue;
+        }
+        p += r;
+        n -= r;
+    }
+}
+
+static void *writer_thread(void *arg)
+{
+    (void) arg;
+
+    for (;;) {
+        sem_wait_intr(&g_async.full_sem);
+
+        // Read before draining: json_async_stop() queues the last buffers
+        // before it sets stopping
+        bool stopping = atomic_load(&g_async.stopping);
+
+        // Drain the queue on every wake up: a pop fails while the producer
+        // of the oldest entry has not finished pushing it, and the entries
+        // behind it are only written after that producer's sem_post().
+        struct async_buf *head;
+        while ((head = queue_pop(&g_async.full_q))) {
+            for (struct async_buf *buf = head; buf; buf = buf->next) {
+                write_all(buf->data, buf->len);
+                if (g_async.write_error) {
+                    drop(buf);
+                } else {
+                    g_async.bytes_written += buf->len;
+                    g_async.buffers_written++;
+                }
+            }
+
+            free_rest(head);
+            queue_push(&g_async.free_q, head);
+            sem_post(&g_async.free_sem);
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void async_write(void *ctx, const char *p, size_t n)
+{
+    (void) ctx;
+
+    while (n) {
+        if (t_dropping) {
+            atomic_fetch_add_explicit(&g_async.bytes_dropped, n, memory_order_relaxed);
+            return;
+        }
+
+        if (t_buf && t_buf->len == g_async.buf_size && g_async.policy == JSON_ASYNC_BLOCK) {
+            // nothing is dropped, so there is no need to hold on to it
+            json_async_commit();
+        }
+
+        if (!t_buf || t_buf->len == g_async.buf_size) {
+            struct async_buf *buf = get_free_buf();
+            if (!buf) {
+                drop_document();
+                continue;
+            }
+            if (t_buf) {
+                t_buf->next = buf;
+            } else {
+                t_head = buf;
+            }
+            t_buf = buf;
+        }
+
+        size_t room = g_async.buf_size - t_buf->len;
+
+        size_t chunk = n < room ? n : room;
+        memcpy(t_buf->data + t_buf->len, p, chunk);
+        t_buf->len += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+int json_async_start(int fd, size_t buf_size, size_t num_bufs, enum json_async_policy policy)
+{
+    int err;
+
+    if (buf_size == 0 || num_bufs == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&g_async, 0, sizeof(g_async));
+    g_async.fd = fd;
+    g_async.buf_size = buf_size;
+    g_async.num_bufs = num_bufs;
+    g_async.policy = policy;
+
+    g_async.bufs = calloc(num_bufs, sizeof(*g_async.bufs));
+    if (!g_async.bufs || queue_init(&g_async.free_q, num_bufs) || queue_init(&g_async.full_q, num_bufs)) {
+        goto err_nomem;
+    }
+
+    for (size_t i = 0; i < num_bufs; ++i) {
+        g_async.bufs[i] = malloc(sizeof(struct async_buf) + buf_size);
+        if (!g_async.bufs[i]) {
+            goto err_nomem;
+        }
+        g_async.bufs[i]->next = NULL;
+        queue_push(&g_async.free_q, g_async.bufs[i]);
+    }
+
+    sem_init(&g_async.free_sem, 0, num_bufs);
+    sem_init(&g_async.full_sem, 0, 0);
+
+    err = pthread_create(&g_async.thread, NULL, writer_thread, NULL);
+    if (err) {
+        sem_destroy(&g_async.free_sem);
+        sem_destroy(&g_async.full_sem);
+        errno = err;
+        goto err_free;
+    }
+
+    fflush(stdout);
+    json_set_sink(async_write, NULL);
+
+    return 0;
+
+err_nomem:
+    errno = ENOMEM;
+err_free:
+    err = errno;
+    for (size_t i = 0; g_async.bufs && i < num_bufs; ++i) {
+        free(g_async.bufs[i]);
+    }
+    free(g_async.bufs);
+    free(g_async.free_q.cells);
+    free(g_async.full_q.cells);
+    errno = err;
+
+    return -1;
+}
+
+void json_async_commit(void)
+{
+    // the dropped document ends here
+    t_dropping = false;
+
+    if (!t_head) {
+        return;
+    }
+
+    if (t_head->len == 0) {
+        // nothing to write, keep it
+        return;
+    }
+
+    queue_push(&g_async.full_q, t_head);
+    sem_post(&g_async.full_sem);
+    t_head = NULL;
+    t_buf = NULL;
+}
+
+void json_async_stop(struct json_async_stats *st)
+{
+    json_async_commit();
+    json_set_sink(NULL, NULL);
+
+    atomic_store(&g_async.stopping, true);
+    sem_post(&g_async.full_sem);
+    pthread_join(g_async.thread, NULL);
+
+    if (st) {
+        st->bytes_written = g_async.bytes_written;
+        st->bytes_dropped = atomic_load(&g_async.bytes_dropped);
+        st->buffers_written = g_async.buffers_written;
+        st->buffers_dropped = atomic_load(&g_async.buffers_dropped);
+        st->write_error = g_async.write_error;
+    }
+
+    // The calling thread's empty buffer is freed with the others
+    t_head = NULL;
+    t_buf = NULL;
+    for (size_t i = 0; i < g_async.num_bufs; ++i) {
+        free(g_async.bufs[i]);
+    }
+    free(g_async.bufs);
+    free(g_async.free_q.cells);
+    free(g_async.full_q.cells);
+    sem_destroy(&g_async.free_sem);
+    sem_destroy(&g_async.full_sem);
+}
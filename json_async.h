@@ -0,0 +1,47 @@
+#ifndef _JSON_ASYNC_H_
+#define _JSON_ASYNC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Asynchronous output: while started, the dumpers write into a buffer of the
+// calling thread, and full buffers are handed to a background thread that
+// writes them to a file descriptor. A dump only waits for I/O with
+// JSON_ASYNC_BLOCK, and only once all buffers are queued.
+
+// What to do when a thread needs an empty buffer and all of them are in use.
+// The drop policies drop whole documents (the output between two calls of
+// json_async_commit()), and keep a document's buffers until it is committed,
+// so a document larger than all buffers together is always dropped.
+enum json_async_policy {
+    // wait for the writer thread to return one
+    JSON_ASYNC_BLOCK,
+    // reuse the buffers of the oldest queued document, dropping it
+    JSON_ASYNC_DROP_OLDEST,
+    // drop the rest of the current document
+    JSON_ASYNC_DROP_NEWEST,
+};
+
+struct json_async_stats {
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;
+    uint64_t buffers_written;
+    uint64_t buffers_dropped;
+    // errno of the first failed write(), the rest of the output is dropped
+    int write_error;
+};
+
+// Start writing to fd with num_bufs buffers of buf_size bytes, shared by all
+// threads that dump. Returns 0, or -1 with errno set.
+int json_async_start(int fd, size_t buf_size, size_t num_bufs, enum json_async_policy policy);
+
+// Queue the calling thread's document. With JSON_ASYNC_BLOCK, buffers are
+// also queued when full. Every thread that dumped must call this before it
+// exits, and before json_async_stop().
+void json_async_commit(void);
+
+// Commit the calling thread's buffer, wait until everything queued is written
+// and switch back to stdout. st (optional) receives the statistics.
+void json_async_stop(struct json_async_stats *st);
+
+#endif
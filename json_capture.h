@@ -0,0 +1,28 @@
+#ifndef _JSON_CAPTURE_H_
+#define _JSON_CAPTURE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Binary capture files, converted to JSON by json_convert: a sequence of
+// records, each a header followed by len bytes of the struct with ID type_id
+// (JSON_STRUCT_ID_*, the index in json_types[]). Everything is in host byte
+// order, without padding between records.
+struct json_capture_record {
+    uint32_t type_id;
+    uint32_t len;
+};
+
+// Append a record to f. Returns 0, or -1 on write errors.
+static inline int json_capture_write(FILE *f, uint32_t type_id, const void *p, uint32_t len)
+{
+    struct json_capture_record r = { .type_id = type_id, .len = len };
+
+    if (fwrite(&r, sizeof(r), 1, f) != 1 || fwrite(p, 1, len, f) != len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+#endif
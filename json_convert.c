@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Convert a binary capture file (see json_capture.h) to JSON, an array with
+// one { "struct name": { members } } object per record, or NDJSON with one
+// such object per line.
+//
+// Linked with generated code compiled with -DJSON_TYPE_TABLE, which provides
+// the dumpers by struct ID (see the json_convert rules in the Makefile). The
+// capture is mapped and split into chunks of records, which worker threads
+// convert into buffers of their own while the main thread writes the buffers
+// in order. Workers only run a few chunks ahead of the output.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util.h"
+#include "json_types.h"
+#include "json_capture.h"
+
+struct chunk {
+    // file offsets of the first record and past the last one
+    size_t start;
+    size_t end;
+    char *out;
+    size_t out_len;
+    bool done;
+};
+
+static struct {
+    const uint8_t *data;
+    bool ndjson;
+    size_t max_size;
+    struct chunk *chunks;
+    size_t num_chunks;
+    // chunks claimed by workers, and written
+    size_t next;
+    size_t written;
+    size_t window;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} g_conv = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// Output buffer of the converting thread, the sink of the dumpers
+struct out_buf {
+    char *p;
+    size_t len;
+    size_t cap;
+};
+
+static __thread struct out_buf *t_out;
+
+static void out_write(void *ctx, const char *p, size_t n)
+{
+    struct out_buf *o = t_out;
+
+    (void) ctx;
+
+    if (n == 0) {
+        return;
+    }
+
+    if (o->len + n > o->cap) {
+        size_t cap = o->cap ? o->cap : 4096;
+        while (cap < o->len + n) {
+            cap *= 2;
+        }
+        o->p = realloc(o->p, cap);
+        assert(o->p);
+        o->cap = cap;
+    }
+
+    memcpy(o->p + o->len, p, n);
+    o->len += n;
+}
+
+// Remove the newlines and indentation of the output from start, JSON strings
+// never contain raw newlines
+static void compact(struct out_buf *o, size_t start)
+{
+    size_t d = start;
+
+    for (size_t s = start; s < o->len; ++s) {
+        if (o->p[s] == '\n') {
+            while (s + 1 < o->len && o->p[s + 1] == ' ') {
+                s++;
+            }
+            continue;
+        }
+        o->p[d++] = o->p[s];
+    }
+
+    o->len = d;
+}
+
+static void convert_chunk(struct chunk *c, size_t idx, void *buf)
+{
+    struct out_buf o = { 0 };
+
+    t_out = &o;
+
+    for (size_t off = c->start; off < c->end;) {
+        struct json_capture_record r;
+        memcpy(&r, g_conv.data + off, sizeof(r));
+        off += sizeof(r);
+
+        const struct json_type_info *t = &json_types[r.type_id];
+        // Copied for the alignment of the struct. Short records (e.g. from
+        // an older, smaller version of the struct) are zero extended.
+        size_t n = r.len < t->size ? r.len : t->size;
+        memcpy(buf, g_conv.data + off, n);
+        memset((char *) buf + n, 0, t->size - n);
+        off += r.len;
+
+        size_t start = o.len;
+        if (g_conv.ndjson) {
+            i_printf(0, "{\n");
+        } else {
+            if (idx != 0 || start != 0) {
+                i_printf(0, ",\n");
+            }
+            i_printf(1, "{\n");
+        }
+        uint32_t indent = g_conv.ndjson ? 0 : 1;
+        t->dump(indent + 1, buf);
+        i_printf(indent, "\n}");
+        if (g_conv.ndjson) {
+            compact(&o, start);
+            i_printf(0, "\n");
+        }
+    }
+
+    t_out = NULL;
+    c->out = o.p;
+    c->out_len = o.len;
+}
+
+static void *worker(void *arg)
+{
+    // one struct of any type, suitably aligned
+    void *buf = aligned_alloc(_Alignof(max_align_t), (g_conv.max_size + _Alignof(max_align_t)) / _Alignof(max_align_t) * _Alignof(max_align_t));
+
+    (void) arg;
+    assert(buf);
+
+    for (;;) {
+        pthread_mutex_lock(&g_conv.lock);
+        while (g_conv.next < g_conv.num_chunks && g_conv.next >= g_conv.written + g_conv.window) {
+            pthread_cond_wait(&g_conv.cond, &g_conv.lock);
+        }
+        size_t i = g_conv.next;
+        if (i < g_conv.num_chunks) {
+            g_conv.next++;
+        }
+        pthread_mutex_unlock(&g_conv.lock);
+
+        if (i == g_conv.num_chunks) {
+            break;
+        }
+
+        convert_chunk(&g_conv.chunks[i], i, buf);
+
+        pthread_mutex_lock(&g_conv.lock);
+        g_conv.chunks[i].done = true;
+        pthread_cond_broadcast(&g_conv.cond);
+        pthread_mutex_unlock(&g_conv.lock);
+    }
+
+    free(buf);
+
+    return NULL;
+}
+
+// Split the records of the size bytes at data into chunks of about
+// chunk_bytes. Returns false for a malformed capture.
+static bool split_chunks(const uint8_t *data, size_t size, size_t chunk_bytes)
+{
+    size_t cap = 0;
+    size_t start = 0;
+    size_t off = 0;
+
+    while (off < size) {
+        struct json_capture_record r;
+
+        if (size - off < sizeof(r)) {
+            fprintf(stderr, "truncated record header at offset %zu\n", off);
+            return false;
+        }
+        memcpy(&r, data + off, sizeof(r));
+        if (r.type_id >= json_num_types) {
+            fprintf(stderr, "unknown type ID %" PRIu32 " at offset %zu\n", r.type_id, off);
+            return false;
+        }
+        if (size - off - sizeof(r) < r.len) {
+            fprintf(stderr, "truncated record at offset %zu\n", off);
+            return false;
+        }
+        off += sizeof(r) + r.len;
+
+        if (off - start >= chunk_bytes || off == size) {
+            if (g_conv.num_chunks == cap) {
+                cap = cap ? cap * 2 : 64;
+                g_conv.chunks = realloc(g_conv.chunks, cap * sizeof(*g_conv.chunks));
+                assert(g_conv.chunks);
+            }
+            g_conv.chunks[g_conv.num_chunks++] = (struct chunk) { .start = start, .end = off };
+            start = off;
+        }
+    }
+
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n] [-j threads] [-c chunk_bytes] [-o output] capture\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunk_bytes = 4 << 20;
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "nj:c:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            g_conv.ndjson = true;
+            break;
+        case 'j':
+            num_threads = strtol(optarg, NULL, 0);
+            break;
+        case 'c':
+            chunk_bytes = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind + 1 != argc || num_threads < 1 || chunk_bytes == 0) {
+        usage(argv[0]);
+    }
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    size_t size = (size_t) st.st_size;
+    if (size) {
+        void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            perror(path);
+            return 1;
+        }
+        madvise(p, size, MADV_SEQUENTIAL);
+        g_conv.data = p;
+    }
+
+    if (!split_chunks(g_conv.data, size, chunk_bytes)) {
+        fprintf(stderr, "%s: malformed capture\n", path);
+        return 1;
+    }
+
+    for (size_t i = 0; i < json_num_types; ++i) {
+        if (json_types[i].size > g_conv.max_size) {
+            g_conv.max_size = json_types[i].size;
+        }
+    }
+
+    g_conv.window = 2 * (size_t) num_threads;
+    json_set_sink(out_write, NULL);
+
+    pthread_t *threads = calloc(num_threads, sizeof(*threads));
+    assert(threads);
+    for (long i = 0; i < num_threads; ++i) {
+        int err = pthread_create(&threads[i], NULL, worker, NULL);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            return 1;
+        }
+    }
+
+    if (!g_conv.ndjson) {
+        fputs("[\n", out);
+    }
+
+    for (size_t i = 0; i < g_conv.num_chunks; ++i) {
+        struct chunk *c = &g_conv.chunks[i];
+
+        pthread_mutex_lock(&g_conv.lock);
+        while (!c->done) {
+            pthread_cond_wait(&g_conv.cond, &g_conv.lock);
+        }
+        pthread_mutex_unlock(&g_conv.lock);
+
+        fwrite(c->out, 1, c->out_len, out);
+        free(c->out);
+
+        pthread_mutex_lock(&g_conv.lock);
+        g_conv.written++;
+        pthread_cond_broadcast(&g_conv.cond);
+        pthread_mutex_unlock(&g_conv.lock);
+    }
+
+    if (!g_conv.ndjson) {
+        fputs("\n]\n", out);
+    }
+
+    for (long i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (fflush(out) != 0 || ferror(out)) {
+        perror(out_path ? out_path : "stdout");
+        return 1;
+    }
+
+    return 0;
+}
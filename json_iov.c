@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "util.h"
+#include "json_iov.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static struct {
+    int fd;
+    char *scratch;
+    size_t scratch_size;
+    size_t scratch_len;
+    struct iovec iov[IOV_MAX];
+    int iov_cnt;
+    // errno of the first failed writev(), returned by the next flush
+    int error;
+} g_iov;
+
+// writev() all of iov, continuing after short writes
+static int writev_all(struct iovec *iov, int cnt)
+{
+    while (cnt) {
+        ssize_t r = writev(g_iov.fd, iov, cnt);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        while (cnt && (size_t) r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt) {
+            iov->iov_base = (char *) iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+
+    return 0;
+}
+
+static void flush_or_record_error(void)
+{
+    if (json_iov_flush() != 0 && !g_iov.error) {
+        g_iov.error = errno;
+    }
+}
+
+// Record n bytes at p, which the caller made room for
+static void add_iov(const char *p, size_t n)
+{
+    // Contiguous with the previous entry, e.g. consecutive values in the
+    // scratch buffer
+    if (g_iov.iov_cnt) {
+        struct iovec *last = &g_iov.iov[g_iov.iov_cnt - 1];
+        if ((const char *) last->iov_base + last->iov_len == p) {
+            last->iov_len += n;
+            return;
+        }
+    }
+
+    g_iov.iov[g_iov.iov_cnt].iov_base = (void *) p;
+    g_iov.iov[g_iov.iov_cnt].iov_len = n;
+    g_iov.iov_cnt++;
+}
+
+static void iov_write_static(void *ctx, const char *p, size_t n)
+{
+    (void) ctx;
+
+    if (n == 0) {
+        return;
+    }
+    if (g_iov.iov_cnt == IOV_MAX) {
+        flush_or_record_error();
+    }
+    add_iov(p, n);
+}
+
+// Everything else is copied, flushing when the scratch buffer is full
+static void iov_write(void *ctx, const char *p, size_t n)
+{
+    (void) ctx;
+
+    while (n) {
+        size_t room = g_iov.scratch_size - g_iov.scratch_len;
+        if (room == 0 || g_iov.iov_cnt == IOV_MAX) {
+            flush_or_record_error();
+            continue;
+        }
+
+        size_t chunk = n < room ? n : room;
+        char *d = g_iov.scratch + g_iov.scratch_len;
+        memcpy(d, p, chunk);
+        g_iov.scratch_len += chunk;
+        add_iov(d, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+int json_iov_start(int fd, size_t scratch_size)
+{
+    if (scratch_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    g_iov.scratch = malloc(scratch_size);
+    if (!g_iov.scratch) {
+        return -1;
+    }
+    g_iov.fd = fd;
+    g_iov.scratch_size = scratch_size;
+    g_iov.scratch_len = 0;
+    g_iov.iov_cnt = 0;
+    g_iov.error = 0;
+
+    fflush(stdout);
+    json_set_sink(iov_write, NULL);
+    json_set_sink_static(iov_write_static);
+
+    return 0;
+}
+
+int json_iov_flush(void)
+{
+    int r = writev_all(g_iov.iov, g_iov.iov_cnt);
+
+    // The output is dropped on errors, there is no way to tell how much of
+    // it was written
+    g_iov.iov_cnt = 0;
+    g_iov.scratch_len = 0;
+
+    if (r == 0 && g_iov.error) {
+        errno = g_iov.error;
+        g_iov.error = 0;
+        r = -1;
+    }
+
+    return r;
+}
+
+int json_iov_stop(void)
+{
+    int r = json_iov_flush();
+
+    json_set_sink(NULL, NULL);
+    free(g_iov.scratch);
+    g_iov.scratch = NULL;
+
+    return r;
+}
@@ -0,0 +1,24 @@
+#ifndef _JSON_IOV_H_
+#define _JSON_IOV_H_
+
+#include <stddef.h>
+
+// Scatter-gather output: while started, the constant text of the dumps (keys,
+// brackets, indentation) is recorded as iovec entries pointing at the string
+// literals of the generated code, only the formatted values are copied into a
+// scratch buffer, and json_iov_flush() writes it all with writev(). The
+// output is flushed early when the scratch buffer or the iovec array fill up.
+// Not thread safe.
+
+// Start writing to fd, with scratch_size bytes of scratch buffer. Returns 0,
+// or -1 with errno set.
+int json_iov_start(int fd, size_t scratch_size);
+
+// Write what was recorded, e.g. after a complete document. Returns 0, or -1
+// with errno set by writev().
+int json_iov_flush(void);
+
+// Flush and switch back to stdout
+int json_iov_stop(void);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "util.h"
+#include "json_mmap.h"
+
+static struct {
+    int fd;
+    size_t chunk_size;
+    size_t page_size;
+    // The mapping covers the file from map_off (page aligned) for map_len
+    // bytes, the output so far ends at pos
+    char *map;
+    off_t map_off;
+    size_t map_len;
+    off_t pos;
+    // errno of the first failure, the rest of the output is dropped
+    int error;
+} g_mmap;
+
+// Map the next chunk_size bytes from pos, preallocating them in the file
+static int map_chunk(void)
+{
+    if (g_mmap.map && munmap(g_mmap.map, g_mmap.map_len) != 0) {
+        return -1;
+    }
+    g_mmap.map = NULL;
+
+    g_mmap.map_off = g_mmap.pos - g_mmap.pos % g_mmap.page_size;
+    g_mmap.map_len = (size_t) (g_mmap.pos - g_mmap.map_off) + g_mmap.chunk_size;
+
+    int err = posix_fallocate(g_mmap.fd, g_mmap.map_off, g_mmap.map_len);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    void *p = mmap(NULL, g_mmap.map_len, PROT_READ | PROT_WRITE, MAP_SHARED, g_mmap.fd, g_mmap.map_off);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    g_mmap.map = p;
+
+    return 0;
+}
+
+static void mmap_write(void *ctx, const char *p, size_t n)
+{
+    (void) ctx;
+
+    while (n && !g_mmap.error) {
+        size_t used = (size_t) (g_mmap.pos - g_mmap.map_off);
+        size_t room = g_mmap.map_len - used;
+        if (room == 0) {
+            if (map_chunk() != 0) {
+                g_mmap.error = errno;
+            }
+            continue;
+        }
+
+        size_t chunk = n < room ? n : room;
+        memcpy(g_mmap.map + used, p, chunk);
+        g_mmap.pos += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+int json_mmap_start(const char *path, size_t chunk_size)
+{
+    if (chunk_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&g_mmap, 0, sizeof(g_mmap));
+    g_mmap.chunk_size = chunk_size;
+    g_mmap.page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    g_mmap.fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_mmap.fd < 0) {
+        return -1;
+    }
+
+    if (map_chunk() != 0) {
+        int err = errno;
+        close(g_mmap.fd);
+        errno = err;
+        return -1;
+    }
+
+    fflush(stdout);
+    json_set_sink(mmap_write, NULL);
+
+    return 0;
+}
+
+int json_mmap_stop(void)
+{
+    int err = g_mmap.error;
+
+    json_set_sink(NULL, NULL);
+
+    if (g_mmap.map && munmap(g_mmap.map, g_mmap.map_len) != 0 && !err) {
+        err = errno;
+    }
+    // drop the preallocated space past the output
+    if (ftruncate(g_mmap.fd, g_mmap.pos) != 0 && !err) {
+        err = errno;
+    }
+    if (close(g_mmap.fd) != 0 && !err) {
+        err = errno;
+    }
+    g_mmap.map = NULL;
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _JSON_MMAP_H_
+#define _JSON_MMAP_H_
+
+#include <stddef.h>
+
+// Memory-mapped file output for bulk captures: while started, the dumpers
+// copy straight into a shared mapping of the output file. The file is
+// preallocated chunk_size bytes at a time and the mapping moved forward as it
+// fills, then truncated to the size of the output on stop. Not thread safe.
+
+// Create (or truncate) path and start writing to it. Returns 0, or -1 with
+// errno set.
+int json_mmap_start(const char *path, size_t chunk_size);
+
+// Unmap, truncate and close the file. Returns 0, or -1 with errno set when any
+// of the output could not be written.
+int json_mmap_stop(void);
+
+#endif
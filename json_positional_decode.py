@@ -0,0 +1,98 @@
+#!/bin/env python3
+#
+# Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+#
+# Permission to use, copy, modify, and distribute this software for
+# any purpose with or without fee is hereby granted, provided that
+# the above copyright notice and this permission notice appear in all
+# copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+# DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+# OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+# TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#
+
+# Decode the positional JSON written by the dump_json_schema_<name>() and
+# dump_json_records_<name>() functions (--positional) back into the JSON of
+# the dumpers: every record, a line [schema ID, values...], becomes a line
+# {"<struct>": {...}} with the keys, nesting and enum names of the schema
+# document with that ID, which has to come first in the input.
+
+import sys
+import json
+import argparse
+
+class DecodeError(Exception):
+    pass
+
+def decode_value(field, values, shape):
+    if shape:
+        return [decode_value(field, values, shape[1:]) for _ in range(shape[0])]
+
+    if "fields" in field:
+        return decode_fields(field["fields"], values)
+
+    try:
+        v = next(values)
+    except StopIteration:
+        raise DecodeError("record too short")
+
+    if "values" in field:
+        return field["values"].get(str(v), "unknown")
+
+    return v
+
+def decode_fields(fields, values):
+    obj = {}
+    for field in fields:
+        obj[field["key"]] = decode_value(field, values, field.get("shape", []))
+
+    return obj
+
+def decode(f, out):
+    schemas = {}
+
+    for num, line in enumerate(f, 1):
+        if not line.strip():
+            continue
+
+        doc = json.loads(line)
+        if isinstance(doc, dict):
+            schemas[doc["schema"]] = doc
+            continue
+
+        schema = schemas.get(doc[0])
+        if schema is None:
+            raise DecodeError("line {}: no schema {}".format(num, doc[0]))
+
+        values = iter(doc[1:])
+        try:
+            obj = decode_fields(schema["fields"], values)
+        except DecodeError as e:
+            raise DecodeError("line {}: {}".format(num, e))
+        if next(values, values) is not values:
+            raise DecodeError("line {}: record too long".format(num))
+
+        out.write(json.dumps({schema["type"]: obj}) + "\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode positional JSON into keyed JSON, one object per line")
+    parser.add_argument("input", nargs="?", help="input file (default: stdin)")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    f = open(args.input) if args.input else sys.stdin
+    out = open(args.output, "w") if args.output else sys.stdout
+
+    try:
+        decode(f, out)
+    except (DecodeError, ValueError, KeyError, IndexError) as e:
+        sys.exit("{}: {}".format(args.input or "stdin", e))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _JSON_REFLECT_HPP_
+#define _JSON_REFLECT_HPP_
+
+// Header-only C++17 JSON serializer driven by the constexpr descriptors that
+// c_header_to_json.py --cxx generates.
+//
+// Every key, separator and member access is a compile time constant and the
+// dispatch on member types happens with if constexpr, so a dump of a struct
+// inlines into straight-line code writing to the sink. The output is the same
+// as that of the generated C dumpers.
+//
+//     json_reflect::file_sink sink(stdout);
+//     json_reflect::writer<json_reflect::file_sink> w(sink);
+//     w.put(0, "{\n");
+//     w.dump(1, s);
+//     w.put(0, "\n}\n");
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace json_reflect {
+
+// Specialized for every generated struct type with:
+//
+//     static constexpr std::string_view name;   // JSON name of the struct
+//     static constexpr std::string_view open;   // "\"<name>\": {\n"
+//     static constexpr auto fields;             // tuple of field<>
+template <typename T>
+struct descriptor;
+
+// Specialized for every generated enum type with:
+//
+//     static constexpr std::string_view to_str(T e);
+template <typename T>
+struct enum_descriptor;
+
+// A member of struct type S of type M. Members of anonymous structs are
+// listed as members of the enclosing struct, flexible array members are not
+// listed.
+template <typename S, typename M>
+struct field {
+    using struct_type = S;
+    using member_type = M;
+
+    // number of array dimensions (0 for non-arrays) and their extents
+    static constexpr std::size_t rank = std::rank_v<M>;
+    template <std::size_t Dim>
+    static constexpr std::size_t extent = std::extent_v<M, Dim>;
+
+    std::string_view name;
+    // the name quoted and followed by ": "
+    std::string_view key;
+    M S::*member;
+};
+
+template <typename S, typename M>
+constexpr field<S, M> make_field(std::string_view name, std::string_view key, M S::*member)
+{
+    return { name, key, member };
+}
+
+// A bit-field of struct type S, which member pointers can not point to, read
+// through a function
+template <typename S, typename M>
+struct bitfield {
+    using struct_type = S;
+    using member_type = M;
+
+    static constexpr std::size_t rank = 0;
+
+    std::string_view name;
+    std::string_view key;
+    M (*get)(const S &);
+};
+
+template <typename S, typename M>
+constexpr bitfield<S, M> make_bitfield(std::string_view name, std::string_view key, M (*get)(const S &))
+{
+    return { name, key, get };
+}
+
+// Sinks receive the output of a writer. Any type with a matching write() can
+// be used as a sink.
+class file_sink {
+public:
+    explicit file_sink(std::FILE *f) : f_(f) {}
+
+    void write(const char *p, std::size_t n)
+    {
+        std::fwrite(p, 1, n, f_);
+    }
+
+private:
+    std::FILE *f_;
+};
+
+class string_sink {
+public:
+    std::string str;
+
+    void write(const char *p, std::size_t n)
+    {
+        str.append(p, n);
+    }
+};
+
+template <typename Sink>
+class writer {
+public:
+    static constexpr std::uint32_t indent_width = 4;
+
+    explicit writer(Sink &sink) : sink_(sink) {}
+
+    // Like i_printf(): every line of s starting at column 0 is indented by
+    // indent levels
+    void put(std::uint32_t indent, std::string_view s)
+    {
+        while (!s.empty()) {
+            if (at_col0_) {
+                pad(indent);
+            }
+
+            std::size_t nl = s.find('\n');
+            if (nl == std::string_view::npos) {
+                sink_.write(s.data(), s.size());
+                at_col0_ = false;
+                return;
+            }
+
+            sink_.write(s.data(), nl + 1);
+            at_col0_ = true;
+            s.remove_prefix(nl + 1);
+        }
+    }
+
+    // Dump v like the generated dump_json_struct_*() of its type does
+    template <typename T>
+    void dump(std::uint32_t indent, const T &v)
+    {
+        using fields_type = std::remove_const_t<decltype(descriptor<T>::fields)>;
+
+        put(indent, descriptor<T>::open);
+        put_fields(indent + 1, v, std::make_index_sequence<std::tuple_size_v<fields_type>>());
+        put(indent, "}");
+    }
+
+private:
+    void pad(std::uint32_t indent)
+    {
+        static constexpr char spaces[64] = {
+            ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+            ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+            ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+            ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ',
+        };
+
+        std::size_t n = (std::size_t) indent * indent_width;
+        while (n) {
+            std::size_t chunk = n < sizeof(spaces) ? n : sizeof(spaces);
+            sink_.write(spaces, chunk);
+            n -= chunk;
+        }
+    }
+
+    // Formatted values are not scanned for newlines, like printf arguments
+    void put_value(std::uint32_t indent, const char *p, std::size_t n)
+    {
+        if (at_col0_) {
+            pad(indent);
+        }
+        sink_.write(p, n);
+        at_col0_ = false;
+    }
+
+    template <typename T, std::size_t... I>
+    void put_fields(std::uint32_t indent, const T &v, std::index_sequence<I...>)
+    {
+        constexpr std::size_t n = sizeof...(I);
+
+        // empty structs have no fields
+        (void) indent;
+        (void) v;
+        (put_field<I + 1 == n>(indent, std::get<I>(descriptor<T>::fields), v), ...);
+    }
+
+    template <typename S, typename M>
+    static const M &member_value(const field<S, M> &f, const S &v)
+    {
+        return v.*f.member;
+    }
+
+    template <typename S, typename M>
+    static M member_value(const bitfield<S, M> &f, const S &v)
+    {
+        return f.get(v);
+    }
+
+    template <bool Last, typename F, typename S>
+    void put_field(std::uint32_t indent, const F &f, const S &v)
+    {
+        using M = typename F::member_type;
+        constexpr std::string_view end = Last ? "\n" : ",\n";
+        const M &m = member_value(f, v);
+
+        if constexpr (std::is_class_v<M>) {
+            dump(indent, m);
+        } else {
+            put(indent, f.key);
+            if constexpr (std::is_array_v<M>) {
+                put_array(indent, m, end);
+            } else {
+                put_scalar(indent, m);
+            }
+        }
+        put(indent, end);
+    }
+
+    // Inner dimensions are separated by newlines, elements of the innermost
+    // dimension are not. Struct elements are each followed by end, as in the
+    // generated C. The innermost dimension of a char array is a string.
+    template <typename M>
+    void put_array(std::uint32_t indent, const M &a, std::string_view end)
+    {
+        using E = std::remove_extent_t<M>;
+
+        if constexpr (std::is_same_v<E, char>) {
+            put_string(indent, a, std::extent_v<M>);
+            return;
+        }
+
+        put(indent, "[");
+        for (std::size_t i = 0; i < std::extent_v<M>; ++i) {
+            if (i != 0) {
+                // strings are elements of the innermost dimension
+                put(indent, std::is_array_v<E> && !std::is_same_v<std::remove_extent_t<E>, char> ? ",\n" : ", ");
+            }
+            if constexpr (std::is_array_v<E>) {
+                put_array(indent, a[i], end);
+            } else if constexpr (std::is_class_v<E>) {
+                dump(indent, a[i]);
+                put(indent, end);
+            } else {
+                put_scalar(indent, a[i]);
+            }
+        }
+        put(indent, "]");
+    }
+
+    template <typename T>
+    void put_scalar(std::uint32_t indent, const T &v)
+    {
+        if constexpr (std::is_enum_v<T>) {
+            std::string_view s = enum_descriptor<T>::to_str(v);
+
+            put(indent, "\"");
+            put_value(indent, s.data(), s.size());
+            put(indent, "\"");
+        } else if constexpr (std::is_same_v<T, char>) {
+            put_string(indent, &v, 1);
+        } else if constexpr (std::is_same_v<T, bool>) {
+            put_value(indent, v ? "1" : "0", 1);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            char buf[32];
+            put_value(indent, buf, format_floating(buf, v));
+        } else {
+            static_assert(std::is_integral_v<T>, "unsupported member type");
+
+            char buf[24];
+            auto r = std::to_chars(buf, buf + sizeof(buf), v);
+            put_value(indent, buf, (std::size_t) (r.ptr - buf));
+        }
+    }
+
+    // Like json_print_string() in util.c: the n chars at s up to the first
+    // NUL, with quotes, backslashes and control characters escaped
+    void put_string(std::uint32_t indent, const char *s, std::size_t n)
+    {
+        put(indent, "\"");
+
+        std::size_t start = 0;
+        std::size_t i = 0;
+        for (; i < n && s[i] != '\0'; ++i) {
+            unsigned char c = (unsigned char) s[i];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+
+            put_value(indent, s + start, i - start);
+            start = i + 1;
+
+            char esc[6] = { '\\', (char) c };
+            std::size_t len = 2;
+            switch (c) {
+            case '"': case '\\': break;
+            case '\b': esc[1] = 'b'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\f': esc[1] = 'f'; break;
+            case '\r': esc[1] = 'r'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = esc[3] = '0';
+                esc[4] = "0123456789abcdef"[c >> 4];
+                esc[5] = "0123456789abcdef"[c & 0xf];
+                len = 6;
+                break;
+            }
+            put_value(indent, esc, len);
+        }
+        put_value(indent, s + start, i - start);
+        put(indent, "\"");
+    }
+
+    // Shortest round-trip digits from std::to_chars(), laid out like
+    // json_format_double() in util.c: positional notation for decimal
+    // exponents in [-4, 16), 1.5e-05 style otherwise. NaN and the infinities
+    // become null.
+    template <typename T>
+    static std::size_t format_floating(char *out, T v)
+    {
+        if (!std::isfinite(v)) {
+            return copy(out, "null");
+        }
+        if (v == 0) {
+            return copy(out, std::signbit(v) ? "-0.0" : "0.0");
+        }
+
+        char sci[32];
+        auto r = std::to_chars(sci, sci + sizeof(sci), v, std::chars_format::scientific);
+        std::string_view s(sci, (std::size_t) (r.ptr - sci));
+
+        char *p = out;
+        if (s[0] == '-') {
+            *p++ = '-';
+            s.remove_prefix(1);
+        }
+
+        std::size_t e = s.find('e');
+        char digits[20];
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < e; ++i) {
+            if (s[i] != '.') {
+                digits[len++] = s[i];
+            }
+        }
+        int x = 0;
+        std::from_chars(s.data() + e + (s[e + 1] == '+' ? 2 : 1), s.data() + s.size(), x);
+
+        if (x < -4 || x >= 16) {
+            *p++ = digits[0];
+            if (len > 1) {
+                *p++ = '.';
+                p = std::copy(digits + 1, digits + len, p);
+            }
+            *p++ = 'e';
+            *p++ = x < 0 ? '-' : '+';
+            int ax = x < 0 ? -x : x;
+            if (ax < 10) {
+                *p++ = '0';
+            }
+            p = std::to_chars(p, p + 4, ax).ptr;
+        } else if (x < 0) {
+            *p++ = '0';
+            *p++ = '.';
+            for (int i = -1; i > x; --i) {
+                *p++ = '0';
+            }
+            p = std::copy(digits, digits + len, p);
+        } else {
+            for (int i = 0; i <= x; ++i) {
+                *p++ = (std::size_t) i < len ? digits[i] : '0';
+            }
+            *p++ = '.';
+            if (len > (std::size_t) x + 1) {
+                p = std::copy(digits + x + 1, digits + len, p);
+            } else {
+                *p++ = '0';
+            }
+        }
+
+        return (std::size_t) (p - out);
+    }
+
+    static std::size_t copy(char *out, std::string_view s)
+    {
+        std::copy(s.begin(), s.end(), out);
+        return s.size();
+    }
+
+    Sink &sink_;
+    bool at_col0_ = true;
+};
+
+} // namespace json_reflect
+
+#endif
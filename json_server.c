@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// accept4()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "util.h"
+#include "json_types.h"
+#include "json_server.h"
+
+// Longest request line, longer ones close the connection
+#define MAX_REQUEST 256
+#define MAX_EVENTS 64
+
+struct registered {
+    const struct json_type_info *type;
+    void *p;
+    pthread_mutex_t *lock;
+};
+
+struct client {
+    struct client *prev;
+    struct client *next;
+    int fd;
+    char in[MAX_REQUEST];
+    size_t in_len;
+    // pending response, sent from out_off
+    char *out;
+    size_t out_len;
+    size_t out_off;
+    size_t out_cap;
+};
+
+struct json_server {
+    int listen_fd;
+    int epoll_fd;
+    int stop_fd;
+    char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+    pthread_t thread;
+    pthread_mutex_t reg_lock;
+    struct registered *reg;
+    size_t num_reg;
+    // connected clients, only used by the server thread
+    struct client *clients;
+};
+
+// The server thread's sink, appending to the response of a client
+static void client_write(void *ctx, const char *p, size_t n)
+{
+    struct client *c = ctx;
+
+    if (c->out_len + n > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + n) {
+            cap *= 2;
+        }
+        char *out = realloc(c->out, cap);
+        if (!out) {
+            // the response is cut short, the client sees invalid JSON
+            return;
+        }
+        c->out = out;
+        c->out_cap = cap;
+    }
+
+    memcpy(c->out + c->out_len, p, n);
+    c->out_len += n;
+}
+
+static void dump_registered(const struct registered *r)
+{
+    if (r->lock) {
+        pthread_mutex_lock(r->lock);
+    }
+    r->type->dump(1, r->p);
+    if (r->lock) {
+        pthread_mutex_unlock(r->lock);
+    }
+}
+
+// Append the response to request line name to the client's output
+static void handle_request(struct json_server *srv, struct client *c, const char *name)
+{
+    bool all = strcmp(name, "*") == 0;
+    bool found = false;
+
+    json_set_thread_sink(client_write, c);
+    i_printf(0, "{\n");
+
+    pthread_mutex_lock(&srv->reg_lock);
+    for (size_t i = 0; i < srv->num_reg; ++i) {
+        const struct registered *r = &srv->reg[i];
+        if (!all && strcmp(r->type->name, name) != 0) {
+            continue;
+        }
+        if (found) {
+            i_printf(0, ",\n");
+        }
+        dump_registered(r);
+        found = true;
+    }
+    pthread_mutex_unlock(&srv->reg_lock);
+
+    if (!found && !all) {
+        i_printf(1, "\"error\": \"unknown struct\"");
+    }
+    i_printf(0, "\n}\n");
+    json_set_thread_sink(NULL, NULL);
+}
+
+static void close_client(struct json_server *srv, struct client *c)
+{
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        srv->clients = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->out);
+    free(c);
+}
+
+// Send as much of the pending response as the socket takes. Returns false
+// when the connection is gone.
+static bool flush_client(struct json_server *srv, struct client *c)
+{
+    while (c->out_off < c->out_len) {
+        ssize_t r = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        c->out_off += r;
+    }
+
+    bool pending = c->out_off < c->out_len;
+    if (!pending) {
+        c->out_off = c->out_len = 0;
+    }
+
+    // Requests are not read while a response is pending, a client that does
+    // not read its responses only holds up itself
+    struct epoll_event ev = { .events = pending ? EPOLLOUT : EPOLLIN, .data.ptr = c };
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+
+    return true;
+}
+
+// Read requests and handle every complete line. Returns false when the
+// connection is closed.
+static bool read_client(struct json_server *srv, struct client *c)
+{
+    ssize_t r;
+
+    do {
+        r = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) {
+        return false;
+    }
+    if (r < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    c->in_len += r;
+
+    char *nl;
+    while ((nl = memchr(c->in, '\n', c->in_len))) {
+        *nl = '\0';
+        if (nl > c->in && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        if (c->in[0]) {
+            handle_request(srv, c, c->in);
+        }
+        size_t used = nl + 1 - c->in;
+        memmove(c->in, nl + 1, c->in_len - used);
+        c->in_len -= used;
+    }
+    if (c->in_len == sizeof(c->in)) {
+        return false;
+    }
+
+    return c->out_len ? flush_client(srv, c) : true;
+}
+
+static void accept_clients(struct json_server *srv)
+{
+    for (;;) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        struct client *c = calloc(1, sizeof(*c));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->next = srv->clients;
+        if (c->next) {
+            c->next->prev = c;
+        }
+        srv->clients = c;
+    }
+}
+
+static void *server_thread(void *arg)
+{
+    struct json_server *srv = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(srv->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &srv->stop_fd) {
+                return NULL;
+            }
+            if (ptr == &srv->listen_fd) {
+                accept_clients(srv);
+                continue;
+            }
+
+            struct client *c = ptr;
+            bool ok;
+            if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                ok = false;
+            } else if (c->out_off < c->out_len) {
+                ok = flush_client(srv, c);
+            } else {
+                ok = read_client(srv, c);
+            }
+            if (!ok) {
+                close_client(srv, c);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+struct json_server *json_server_start(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct json_server *srv;
+    bool bound = false;
+    int err;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    srv = calloc(1, sizeof(*srv));
+    if (!srv) {
+        return NULL;
+    }
+    srv->listen_fd = srv->epoll_fd = srv->stop_fd = -1;
+    strcpy(srv->path, path);
+    strcpy(addr.sun_path, path);
+    pthread_mutex_init(&srv->reg_lock, NULL);
+
+    srv->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd < 0) {
+        goto err;
+    }
+    // Replace a stale socket from an earlier run, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EADDRINUSE;
+            goto err;
+        }
+        unlink(path);
+    }
+    if (bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        goto err;
+    }
+    bound = true;
+    if (listen(srv->listen_fd, SOMAXCONN) != 0) {
+        goto err;
+    }
+
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    srv->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (srv->epoll_fd < 0 || srv->stop_fd < 0) {
+        goto err;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &srv->listen_fd };
+    struct epoll_event stop_ev = { .events = EPOLLIN, .data.ptr = &srv->stop_fd };
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) != 0 ||
+        epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->stop_fd, &stop_ev) != 0) {
+        goto err;
+    }
+
+    err = pthread_create(&srv->thread, NULL, server_thread, srv);
+    if (err) {
+        errno = err;
+        goto err;
+    }
+
+    return srv;
+
+err:
+    err = errno;
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+    }
+    if (bound) {
+        unlink(path);
+    }
+    if (srv->epoll_fd >= 0) {
+        close(srv->epoll_fd);
+    }
+    if (srv->stop_fd >= 0) {
+        close(srv->stop_fd);
+    }
+    free(srv);
+    errno = err;
+
+    return NULL;
+}
+
+int json_server_register(struct json_server *srv, const char *name, void *p, pthread_mutex_t *lock)
+{
+    const struct json_type_info *type = json_type_lookup(name);
+
+    if (!type) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&srv->reg_lock);
+    struct registered *reg = realloc(srv->reg, (srv->num_reg + 1) * sizeof(*reg));
+    if (!reg) {
+        pthread_mutex_unlock(&srv->reg_lock);
+        return -1;
+    }
+    reg[srv->num_reg++] = (struct registered) { .type = type, .p = p, .lock = lock };
+    srv->reg = reg;
+    pthread_mutex_unlock(&srv->reg_lock);
+
+    return 0;
+}
+
+void json_server_stop(struct json_server *srv)
+{
+    uint64_t one = 1;
+
+    if (write(srv->stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        abort();
+    }
+    pthread_join(srv->thread, NULL);
+
+    while (srv->clients) {
+        close_client(srv, srv->clients);
+    }
+    close(srv->listen_fd);
+    unlink(srv->path);
+
+    close(srv->epoll_fd);
+    close(srv->stop_fd);
+    pthread_mutex_destroy(&srv->reg_lock);
+    free(srv->reg);
+    free(srv);
+}
@@ -0,0 +1,31 @@
+#ifndef _JSON_SERVER_H_
+#define _JSON_SERVER_H_
+
+#include <pthread.h>
+
+// On-demand stats over a Unix domain socket: a server thread with an epoll
+// event loop accepts any number of clients, which send struct names, one per
+// line, and get back the registered instance of each as a JSON document
+// ("*" returns all of them in one document). Structs are only dumped when
+// asked for. Dumpers are found by name in json_types[], so the generated
+// code must be compiled with -DJSON_TYPE_TABLE.
+//
+// e.g. echo ath12k_htt_tx_pdev_stats_cmn_tlv | socat - UNIX-CONNECT:stats.sock
+
+struct json_server;
+
+// Listen on path (replacing a stale socket, but failing with EADDRINUSE for
+// anything else) and start the server thread.
+// Returns NULL with errno set on failure.
+struct json_server *json_server_start(const char *path);
+
+// Serve the struct at p of type name (the tag) until the server stops. The
+// server thread dumps it with lock held, if not NULL, so that the host can
+// keep it consistent. Returns 0, or -1 with errno set when there is no
+// dumper for name.
+int json_server_register(struct json_server *srv, const char *name, void *p, pthread_mutex_t *lock);
+
+// Stop the server thread, close all connections and remove the socket
+void json_server_stop(struct json_server *srv);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Segment layout: a header, num_slots slot descriptors, then the data of the
+// slots, each at a cache line boundary. The sequence number of a slot is odd
+// while it is being written, and counts publishes times two.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "json_shm.h"
+
+#define JSON_SHM_MAGIC 0x6e6f736a5f6d6873ull
+#define JSON_SHM_VERSION 1
+#define JSON_SHM_ALIGN 64
+#define JSON_SHM_MAX_TRIES 1000000
+
+struct shm_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t max_slots;
+    uint64_t size;
+    uint64_t data_offset;
+    // used bytes of the data area, only written by the producer
+    uint64_t data_used;
+    // slots added so far, published with release after the slot descriptor
+    _Atomic uint32_t num_slots;
+};
+
+struct shm_slot {
+    char name[JSON_SHM_NAME_MAX];
+    uint64_t size;
+    uint64_t offset;
+    _Alignas(JSON_SHM_ALIGN) _Atomic uint64_t seq;
+};
+
+struct json_shm {
+    struct shm_header *hdr;
+    struct shm_slot *slots;
+    size_t size;
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + JSON_SHM_ALIGN - 1) / JSON_SHM_ALIGN * JSON_SHM_ALIGN;
+}
+
+static struct json_shm *map_segment(int fd, size_t size, int prot)
+{
+    struct json_shm *shm = malloc(sizeof(*shm));
+    if (!shm) {
+        return NULL;
+    }
+
+    void *p = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        free(shm);
+        return NULL;
+    }
+
+    shm->hdr = p;
+    shm->slots = (struct shm_slot *) ((char *) p + align_up(sizeof(struct shm_header)));
+    shm->size = size;
+
+    return shm;
+}
+
+struct json_shm *json_shm_create(const char *name, size_t num_slots, size_t data_size)
+{
+    size_t data_offset = align_up(sizeof(struct shm_header)) + num_slots * sizeof(struct shm_slot);
+    size_t size = data_offset + align_up(data_size);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct json_shm *shm = NULL;
+    if (ftruncate(fd, size) == 0) {
+        shm = map_segment(fd, size, PROT_READ | PROT_WRITE);
+    }
+    int err = errno;
+    close(fd);
+    if (!shm) {
+        shm_unlink(name);
+        errno = err;
+        return NULL;
+    }
+
+    // The segment is zero filled, readers see no slots until num_slots is
+    // set, and the header is only valid once the magic is
+    shm->hdr->version = JSON_SHM_VERSION;
+    shm->hdr->max_slots = num_slots;
+    shm->hdr->size = size;
+    shm->hdr->data_offset = data_offset;
+    atomic_thread_fence(memory_order_release);
+    shm->hdr->magic = JSON_SHM_MAGIC;
+
+    return shm;
+}
+
+int json_shm_add(struct json_shm *shm, const char *type_name, size_t size)
+{
+    struct shm_header *h = shm->hdr;
+    uint32_t n = atomic_load_explicit(&h->num_slots, memory_order_relaxed);
+
+    if (n == h->max_slots || align_up(size) > h->size - h->data_offset - h->data_used ||
+        strlen(type_name) >= JSON_SHM_NAME_MAX) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    struct shm_slot *s = &shm->slots[n];
+    strcpy(s->name, type_name);
+    s->size = size;
+    s->offset = h->data_offset + h->data_used;
+    h->data_used += align_up(size);
+    atomic_store_explicit(&h->num_slots, n + 1, memory_order_release);
+
+    return (int) n;
+}
+
+void json_shm_publish(struct json_shm *shm, int slot, const void *p)
+{
+    struct shm_slot *s = &shm->slots[slot];
+    uint64_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    // the odd sequence number is visible before any of the data
+    atomic_thread_fence(memory_order_release);
+    memcpy((char *) shm->hdr + s->offset, p, s->size);
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+struct json_shm *json_shm_open(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    struct json_shm *shm = NULL;
+    if (fstat(fd, &st) == 0) {
+        if ((size_t) st.st_size < sizeof(struct shm_header)) {
+            errno = EINVAL;
+        } else {
+            shm = map_segment(fd, st.st_size, PROT_READ);
+        }
+    }
+    int err = errno;
+    close(fd);
+    if (!shm) {
+        errno = err;
+        return NULL;
+    }
+
+    // The segment comes from another process, the slot table has to fit
+    // before anything in it is trusted
+    const struct shm_header *h = shm->hdr;
+    if (h->magic != JSON_SHM_MAGIC || h->version != JSON_SHM_VERSION || h->size != shm->size ||
+        h->data_offset > h->size ||
+        h->max_slots > (h->data_offset - align_up(sizeof(struct shm_header))) / sizeof(struct shm_slot)) {
+        json_shm_close(shm);
+        errno = EPROTO;
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    return shm;
+}
+
+size_t json_shm_num_slots(const struct json_shm *shm)
+{
+    uint32_t n = atomic_load_explicit(&shm->hdr->num_slots, memory_order_acquire);
+
+    return n <= shm->hdr->max_slots ? n : 0;
+}
+
+const char *json_shm_slot_name(const struct json_shm *shm, size_t slot)
+{
+    const char *name = shm->slots[slot].name;
+
+    return memchr(name, '\0', JSON_SHM_NAME_MAX) ? name : "";
+}
+
+size_t json_shm_slot_size(const struct json_shm *shm, size_t slot)
+{
+    return shm->slots[slot].size;
+}
+
+uint64_t json_shm_read(const struct json_shm *shm, size_t slot, void *buf)
+{
+    struct shm_slot *s = &shm->slots[slot];
+    uint64_t offset = s->offset;
+    uint64_t size = s->size;
+    uint64_t seq;
+
+    if (offset < shm->hdr->data_offset || offset > shm->size || size > shm->size - offset) {
+        return JSON_SHM_TORN;
+    }
+
+    for (uint32_t tries = 0;; ++tries) {
+        seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1) {
+            // A writer that died in the middle of a publish leaves the
+            // slot odd forever
+            if (tries == JSON_SHM_MAX_TRIES) {
+                return JSON_SHM_TORN;
+            }
+            sched_yield();
+            continue;
+        }
+        memcpy(buf, (const char *) shm->hdr + offset, size);
+        // the copy is complete before the sequence number is read again
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
+    return seq / 2;
+}
+
+void json_shm_close(struct json_shm *shm)
+{
+    munmap(shm->hdr, shm->size);
+    free(shm);
+}
@@ -0,0 +1,50 @@
+#ifndef _JSON_SHM_H_
+#define _JSON_SHM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared-memory export: the monitored process publishes structs into slots of
+// a POSIX shared-memory segment, and a separate process (json_shm_reader)
+// renders them to JSON on demand. Publishing is a memcpy() under a per-slot
+// seqlock; readers retry while a slot is being written, and never block the
+// writer. Each slot has a single writer.
+
+#define JSON_SHM_NAME_MAX 64
+
+struct json_shm;
+
+// Create segment name (e.g. "/stats") with room for num_slots slots and
+// data_size bytes of struct data. Returns NULL with errno set on failure,
+// EEXIST when the segment already exists; shm_unlink() it first to replace it.
+struct json_shm *json_shm_create(const char *name, size_t num_slots, size_t data_size);
+
+// Add a slot for a struct of type_name (the tag, as in json_types[]) and
+// size bytes. Returns the slot index, or -1 with errno set when the segment
+// is full.
+int json_shm_add(struct json_shm *shm, const char *type_name, size_t size);
+
+#define JSON_SHM_ADD(shm, tag) json_shm_add(shm, #tag, sizeof(struct tag))
+
+// Copy the struct at p into slot
+void json_shm_publish(struct json_shm *shm, int slot, const void *p);
+
+// Attach to segment name read-only. Returns NULL with errno set on failure,
+// EPROTO when the header or slot table does not fit the segment.
+struct json_shm *json_shm_open(const char *name);
+
+size_t json_shm_num_slots(const struct json_shm *shm);
+const char *json_shm_slot_name(const struct json_shm *shm, size_t slot);
+size_t json_shm_slot_size(const struct json_shm *shm, size_t slot);
+
+// Consistent copy of slot into buf (json_shm_slot_size() bytes). Returns the
+// number of times the slot was published, 0 if never, or JSON_SHM_TORN when
+// the slot stays in the middle of a publish or its data is outside the segment.
+#define JSON_SHM_TORN UINT64_MAX
+
+uint64_t json_shm_read(const struct json_shm *shm, size_t slot, void *buf);
+
+// Detach, the segment stays until shm_unlink()
+void json_shm_close(struct json_shm *shm);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2025 Nathaniel Houghton <nathan@brainwerk.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for
+ * any purpose with or without fee is hereby granted, provided that
+ * the above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Render the slots of a shared-memory export (see json_shm.h) to JSON, in the
+// layout of the test programs: { "struct name": { members }, ... }.
+//
+// Linked with generated code compiled with -DJSON_TYPE_TABLE, like
+// json_convert; slots are matched to dumpers by struct name.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "util.h"
+#include "json_types.h"
+#include "json_shm.h"
+
+static bool selected(const char *name, char **names, int num_names)
+{
+    if (num_names == 0) {
+        return true;
+    }
+    for (int i = 0; i < num_names; ++i) {
+        if (strcmp(names[i], name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-u] segment [struct...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    bool unlink_segment = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u")) != -1) {
+        switch (opt) {
+        case 'u':
+            unlink_segment = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+    }
+
+    const char *name = argv[optind];
+    struct json_shm *shm = json_shm_open(name);
+    if (!shm) {
+        perror(name);
+        return 1;
+    }
+
+    int ret = 0;
+    bool first = true;
+    void *buf = NULL;
+
+    i_printf(0, "{\n");
+    for (size_t i = 0; i < json_shm_num_slots(shm); ++i) {
+        const char *type_name = json_shm_slot_name(shm, i);
+        if (!selected(type_name, argv + optind + 1, argc - optind - 1)) {
+            continue;
+        }
+
+        const struct json_type_info *t = json_type_lookup(type_name);
+        if (!t || t->size != json_shm_slot_size(shm, i)) {
+            fprintf(stderr, "%s: no dumper for slot %zu (struct %s of %zu bytes)\n", name, i, type_name,
+                json_shm_slot_size(shm, i));
+            ret = 1;
+            continue;
+        }
+
+        // Suitably aligned for the dumper
+        free(buf);
+        buf = aligned_alloc(_Alignof(max_align_t), (t->size + _Alignof(max_align_t)) / _Alignof(max_align_t) * _Alignof(max_align_t));
+        if (!buf) {
+            perror("aligned_alloc");
+            return 1;
+        }
+        if (json_shm_read(shm, i, buf) == JSON_SHM_TORN) {
+            fprintf(stderr, "%s: slot %zu (struct %s) is torn\n", name, i, type_name);
+            ret = 1;
+            continue;
+        }
+
+        if (!first) {
+            i_printf(0, ",\n");
+        }
+        t->dump(1, buf);
+        first = false;
+    }
+    i_printf(0, "\n}\n");
+
+    free(buf);
+    json_shm_close(shm);
+    if (unlink_segment && shm_unlink(name) != 0) {
+        perror(name);
+        ret = 1;
+    }
+
+    return ret;
+}
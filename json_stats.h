@@ -0,0 +1,69 @@
+#ifndef _JSON_STATS_H_
+#define _JSON_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(JSON_STATS_RDTSC) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "json_stats_input.h"
+
+// Serialization instrumentation. Generated dumpers only reference these when
+// compiled with -DJSON_STATS; otherwise none of this code is present.
+
+// Bytes emitted by i_printf on the calling thread (only maintained when util.c
+// is built with -DJSON_STATS).
+extern __thread uint64_t json_bytes_out;
+
+struct json_stats_probe {
+    uint64_t start_ticks;
+    uint64_t start_bytes;
+};
+
+static inline uint64_t json_stats_ticks(void)
+{
+#if defined(JSON_STATS_RDTSC) && defined(__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+static inline void json_stats_begin(struct json_stats_probe *p)
+{
+    p->start_bytes = json_bytes_out;
+    p->start_ticks = json_stats_ticks();
+}
+
+static inline void json_stats_end(const struct json_stats_probe *p, struct json_struct_stats *st)
+{
+    uint64_t ticks = json_stats_ticks() - p->start_ticks;
+    uint32_t bucket = 0;
+
+    if (ticks > 1) {
+        bucket = 63 - __builtin_clzll(ticks);
+        if (bucket >= JSON_STATS_HIST_BUCKETS) {
+            bucket = JSON_STATS_HIST_BUCKETS - 1;
+        }
+    }
+
+    st->calls++;
+    st->bytes += json_bytes_out - p->start_bytes;
+    st->total_ticks += ticks;
+    if (ticks > st->max_ticks) {
+        st->max_ticks = ticks;
+    }
+    st->latency_hist[bucket]++;
+}
+
+// Print the statistics of one struct type as a "name": { ... } JSON member.
+void json_stats_dump_entry(uint32_t indent_level, const char *name, struct json_struct_stats *st);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _JSON_STATS_INPUT_H_
+#define _JSON_STATS_INPUT_H_
+
+#include <stdint.h>
+
+// Number of log2 latency buckets. Bucket b counts the calls whose latency fell
+// in [2^b, 2^(b+1)) ticks, the last bucket also collects everything above.
+#define JSON_STATS_HIST_BUCKETS 32
+
+// Per struct type serialization statistics. This header is also fed through
+// c_header_to_json.py so that the statistics are exported by the serializer
+// itself.
+//
+// Latencies and byte counts are inclusive of nested dumpers. A tick is a
+// nanosecond, or a TSC cycle when built with JSON_STATS_RDTSC.
+struct json_struct_stats {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t total_ticks;
+    uint64_t max_ticks;
+    uint64_t latency_hist[JSON_STATS_HIST_BUCKETS];
+};
+
+#endif
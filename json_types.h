@@ -0,0 +1,59 @@
+#ifndef _JSON_TYPES_H_
+#define _JSON_TYPES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Description of a generated struct dumper. Generated code compiled with
+// -DJSON_TYPE_TABLE defines json_types[], indexed by struct ID.
+struct json_type_info {
+    const char *name;
+    size_t size;
+    void (*dump)(uint32_t indent_level, void *p);
+    // the JSON_STRUCT_ID_* constant, also the ID of positional schemas
+    uint32_t id;
+    // Make every _Bool member of the struct at p 0 or 1, e.g. after filling
+    // it with random bytes, NULL for structs without any. Any bytes are valid
+    // for the other members.
+    void (*fix)(void *p);
+};
+
+// Description of a generated enum, json_enums[] is indexed by id
+struct json_enum_info {
+    const char *name;
+    size_t size;
+    const char *(*to_str)(int64_t value);
+    uint32_t id;
+};
+
+extern const struct json_type_info json_types[];
+extern const size_t json_num_types;
+extern const struct json_enum_info json_enums[];
+extern const size_t json_num_enums;
+
+// Find a struct or enum by name (without the "struct " or "enum " prefix), or
+// return NULL. The generator builds a minimal perfect hash of the names, so a
+// lookup hashes the name at most twice and compares it with a single entry.
+const struct json_type_info *json_type_lookup(const char *name);
+const struct json_enum_info *json_enum_lookup(const char *name);
+
+// The hash of the lookups, FNV-1a with the murmur3 finalizer. It must match
+// json_type_hash() in c_header_to_json.py.
+static inline uint32_t json_type_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    for (const unsigned char *c = (const unsigned char *) name; *c; ++c) {
+        h ^= *c;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+#endif
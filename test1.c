@@ -5,18 +5,89 @@
 #include <string.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <math.h>
 
 #include "util.h"
 #include "test1_input.h"
-#include "test1_out.c"
+// The generated code, from the preprocessed header by default
+#ifndef TEST1_OUT
+#define TEST1_OUT "test1_out.c"
+#endif
+#include TEST1_OUT
+
+#ifdef TEST1_BIG_ENDIAN
+// test1_be is generated with --byte-order big: store the width byte elements
+// of the size bytes at p big endian
+static void to_big_endian(void *p, size_t size, size_t width)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (uint8_t *e = p; e < (uint8_t *) p + size; e += width) {
+        for (size_t i = 0; i < width / 2; ++i) {
+            uint8_t tmp = e[i];
+            e[i] = e[width - 1 - i];
+            e[width - 1 - i] = tmp;
+        }
+    }
+#else
+    (void) p;
+    (void) size;
+    (void) width;
+#endif
+}
+
+#define TO_BIG_ENDIAN(x, elem) to_big_endian(&(x), sizeof(x), sizeof(elem))
+#endif
 
 int main(int argc, char **argv)
 {
     (void) argc;
     (void) argv;
 
-    struct test t = { .c = 'x', .anon_internal_b = 'q', .nested_struct_name_0 = { .internal_struct_b = 'r' }, .nested_struct_name_1 = { .internal_named_struct_b = 'm' } };
+    struct test t = { .c = 'x', .ratio = 0.1f, .avg_latency = 1.0 / 3, .samples = { -0.0, 1e100, 5e-324, HUGE_VAL },
+        .name = "stats \"rx\" C:\\tmp\n\t\x01 caf\xc3\xa9 and more", .tag = { 'a', 'b', 'c', 'd' }, .lanes = { "lane0", "lane1" },
+        .grid = { [0][1][2] = -32768, [1][2][3] = 32767 }, .weights = { [0][2] = 0.5, [1][0] = -2.25 },
+        .state = TEST_RUNNING, .lane_load = { [TEST_LANE_FIRST] = 65535 },
+        .anon_internal_b = 'q', .nested_struct_name_0 = { .internal_struct_b = 'r' }, .nested_struct_name_1 = { .internal_named_struct_b = 'm' },
+        .packed = { .kind = 1, .value = 0xdeadbeef } };
 
+#ifdef TEST1_BIG_ENDIAN
+    TO_BIG_ENDIAN(t.a, t.a);
+    TO_BIG_ENDIAN(t.b, t.b);
+    TO_BIG_ENDIAN(t.x, t.x);
+    TO_BIG_ENDIAN(t.q64, t.q64);
+    TO_BIG_ENDIAN(t.ultest, t.ultest);
+    TO_BIG_ENDIAN(t.ratio, t.ratio);
+    TO_BIG_ENDIAN(t.avg_latency, t.avg_latency);
+    TO_BIG_ENDIAN(t.samples, t.samples[0]);
+    TO_BIG_ENDIAN(t.grid, t.grid[0][0][0]);
+    TO_BIG_ENDIAN(t.weights, t.weights[0][0]);
+    TO_BIG_ENDIAN(t.state, t.state);
+    TO_BIG_ENDIAN(t.lane_load, t.lane_load[0]);
+    TO_BIG_ENDIAN(t.anon_internal_a, t.anon_internal_a);
+    TO_BIG_ENDIAN(t.nested_struct_name_0.internal_struct_a, t.nested_struct_name_0.internal_struct_a);
+    TO_BIG_ENDIAN(t.nested_struct_name_1.internal_named_struct_a, t.nested_struct_name_1.internal_named_struct_a);
+    TO_BIG_ENDIAN(t.packed.value, t.packed.value);
+#endif
+#ifdef TEST1_POSITIONAL
+    dump_json_schema_test();
+    dump_json_records_test(&t, 1);
+    return 0;
+#endif
+#ifdef TEST1_CSV
+    // a time series of three snapshots, as TSV
+    struct test rows[3] = { t, t, t };
+    rows[1].a = 1;
+    rows[2].a = 2;
+    rows[2].x = UINT32_MAX;
+    dump_csv_header_test('\t');
+    dump_csv_rows_test(rows, 3, '\t');
+    return 0;
+#endif
+#ifdef TEST1_OPENMETRICS
+    dump_openmetrics_struct_test(&t);
+    i_printf(0, "# EOF\n");
+    return 0;
+#endif
     i_printf(0, "{\n");
     dump_json_struct_test(1, &t);
     i_printf(0, "\n}\n");
@@ -0,0 +1,41 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "json_reflect.hpp"
+#include "test1_reflect.hpp"
+
+// Same output as test1, from the C++ reflection backend
+int main()
+{
+    struct test t = {};
+    t.c = 'x';
+    t.ratio = 0.1f;
+    t.avg_latency = 1.0 / 3;
+    t.samples[0] = -0.0;
+    t.samples[1] = 1e100;
+    t.samples[2] = 5e-324;
+    t.samples[3] = HUGE_VAL;
+    std::strcpy(t.name, "stats \"rx\" C:\\tmp\n\t\x01 caf\xc3\xa9 and more");
+    std::memcpy(t.tag, "abcd", 4);
+    std::strcpy(t.lanes[0], "lane0");
+    std::strcpy(t.lanes[1], "lane1");
+    t.grid[0][1][2] = -32768;
+    t.grid[1][2][3] = 32767;
+    t.weights[0][2] = 0.5;
+    t.weights[1][0] = -2.25;
+    t.state = TEST_RUNNING;
+    t.lane_load[TEST_LANE_FIRST] = 65535;
+    t.packed.kind = 1;
+    t.packed.value = 0xdeadbeef;
+    t.anon_internal_b = 'q';
+    t.nested_struct_name_0.internal_struct_b = 'r';
+    t.nested_struct_name_1.internal_named_struct_b = 'm';
+
+    json_reflect::file_sink sink(stdout);
+    json_reflect::writer<json_reflect::file_sink> w(sink);
+
+    w.put(0, "{\n");
+    w.dump(1, t);
+    w.put(0, "\n}\n");
+}
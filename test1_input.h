@@ -3,6 +3,25 @@
 struct other_struct {
 };
 
+enum test_state {
+    TEST_IDLE,
+    TEST_RUNNING,
+    TEST_STOPPED,
+};
+
+// implicit values follow the explicit ones, TEST_LANE_COUNT is 6
+enum test_lane {
+    TEST_LANE_FIRST = 5,
+    TEST_LANE_COUNT,
+};
+
+// packed, with another attribute in the same list (aligned, so that the C++
+// dumper, which does not support packed structs, can dump it too)
+struct __attribute__((packed, aligned(4))) test_packed {
+    uint32_t value;
+    uint8_t kind;
+};
+
 struct test {
     int a;
     int b;
@@ -11,6 +30,16 @@ struct test {
     uint8_t q;
     int64_t q64;
     unsigned long ultest;
+    float ratio;
+    double avg_latency;
+    double samples[4];
+    char name[40];
+    char tag[4];
+    char lanes[2][8];
+    int16_t grid[2][3][4];
+    double weights[2][3];
+    enum test_state state;
+    uint16_t lane_load[TEST_LANE_COUNT];
 //    char *char_ptr;
 //    int *int_ptr;
     // this struct has no tag and no name (anonymous, untagged)
@@ -40,6 +69,7 @@ struct test {
     struct internal_empty_struct {
     } internal_empty1;
 
+    struct test_packed packed;
     struct other_struct other_struct_x;
     struct other_struct other_struct_y;
 };
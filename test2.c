@@ -8,21 +8,20 @@
 
 #include "util.h"
 #include "test2_input.h"
-#include "test2_out.c"
+#ifndef TEST2_OUT
+#define TEST2_OUT "test2_out.h"
+#endif
+#include TEST2_OUT
+#include "test2_fixture.h"
 
+// The plain JSON dump. The other backends have their own drivers, e.g.
+// test2_async.c or test2_server.c.
 int main(int argc, char **argv)
 {
     (void) argc;
     (void) argv;
 
-    struct ath12k_htt_tx_pdev_stats_cmn_tlv a = {};
-    struct ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv b = {};
-    struct ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv c = {};
-    i_printf(0, "{\n");
-    dump_json_struct_ath12k_htt_tx_pdev_stats_cmn_tlv(1, &a);
-    i_printf(0, ",\n");
-    dump_json_struct_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv(1, &b);
-    i_printf(0, ",\n");
-    dump_json_struct_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(1, &c);
-    i_printf(0, "\n}\n");
+    struct test2_tlvs t;
+    test2_init(&t);
+    test2_dump_json(&t);
 }
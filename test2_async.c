@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "json_async.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// Copies the pipe the writer thread writes to onto stdout
+static void *drain_pipe(void *arg)
+{
+    int fd = *(int *) arg;
+    char buf[4096];
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (write(STDOUT_FILENO, buf, n) != n) {
+            perror("write");
+            exit(1);
+        }
+    }
+
+    return NULL;
+}
+
+// The JSON dump through small buffers, so that the output is split across
+// many of them
+static int write_blocking(const struct test2_tlvs *t)
+{
+    struct json_async_stats st;
+
+    if (json_async_start(STDOUT_FILENO, 256, 4, JSON_ASYNC_BLOCK) != 0) {
+        perror("json_async_start");
+        return 1;
+    }
+    test2_dump_json(t);
+    json_async_commit();
+    json_async_stop(&st);
+    assert(st.bytes_dropped == 0 && st.write_error == 0);
+
+    return 0;
+}
+
+// Many documents, each split across several buffers, through buffers for
+// only two of them and into a pipe that is not read until all of them are
+// committed. The writer thread blocks once the pipe is full, so documents are
+// always dropped with the policy.
+static int write_dropping(const struct test2_tlvs *t, enum json_async_policy policy)
+{
+    struct json_async_stats st;
+    int pipe_fds[2];
+    pthread_t drainer;
+
+    if (pipe(pipe_fds) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    if (json_async_start(pipe_fds[1], 1024, 8, policy) != 0) {
+        perror("json_async_start");
+        return 1;
+    }
+    for (int doc = 0; doc < 2000; ++doc) {
+        test2_dump_json(t);
+        json_async_commit();
+    }
+
+    if (pthread_create(&drainer, NULL, drain_pipe, &pipe_fds[0]) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+    json_async_stop(&st);
+    close(pipe_fds[1]);
+    pthread_join(drainer, NULL);
+    assert(st.bytes_dropped > 0 && st.write_error == 0);
+
+    return 0;
+}
+
+// Without arguments, the JSON dump through the asynchronous writer. With
+// newest or oldest, documents dropped with that policy.
+int main(int argc, char **argv)
+{
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    if (argc == 1) {
+        return write_blocking(&t);
+    } else if (argc == 2 && strcmp(argv[1], "newest") == 0) {
+        return write_dropping(&t, JSON_ASYNC_DROP_NEWEST);
+    } else if (argc == 2 && strcmp(argv[1], "oldest") == 0) {
+        return write_dropping(&t, JSON_ASYNC_DROP_OLDEST);
+    }
+
+    fprintf(stderr, "usage: %s [newest|oldest]\n", argv[0]);
+    return 1;
+}
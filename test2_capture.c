@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "json_capture.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// Write the TLVs as a capture for json_convert, the first records as test2
+// dumps them and then more with other values
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s CAPTURE\n", argv[0]);
+        return 1;
+    }
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    FILE *cap = fopen(argv[1], "wb");
+    if (!cap) {
+        perror(argv[1]);
+        return 1;
+    }
+    for (uint32_t i = 0; i < 500; ++i) {
+        t.urrn.____dummy = TEST2_U32(1 + i);
+        t.flush.____dummy = TEST2_U32(2 + i);
+        if (json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_stats_cmn_tlv, &t.cmn, sizeof(t.cmn)) ||
+            json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv, &t.mu_ppdu, sizeof(t.mu_ppdu)) ||
+            json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv, &t.ofdma, sizeof(t.ofdma)) ||
+            json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_stats_urrn_tlv, &t.urrn, sizeof(t.urrn)) ||
+            // a short record, zero extended by json_convert
+            json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_stats_flush_tlv, &t.flush, i ? 2 : sizeof(t.flush)) ||
+            json_capture_write(cap, JSON_STRUCT_ID_ath12k_htt_tx_pdev_stats_phy_err_tlv, &t.phy_err, sizeof(t.phy_err))) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    if (fclose(cap) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// A time series of three snapshots of one TLV (--csv), the first one as test2
+// dumps it
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    struct ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv rows[3] = { t.ofdma, t.ofdma, t.ofdma };
+    rows[1].be_ofdma_tx_ldpc = TEST2_U32(1);
+    rows[2].be_ofdma_tx_ldpc = TEST2_U32(2);
+    rows[2].gi[3][1] = TEST2_U32(UINT32_MAX);
+    dump_csv_header_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(',');
+    dump_csv_rows_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(at_odd_offset(rows, sizeof(rows)), 3, ',');
+
+    return 0;
+}
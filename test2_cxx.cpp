@@ -0,0 +1,38 @@
+#include <cstdio>
+
+#include "json_reflect.hpp"
+#include "test2_reflect.hpp"
+
+// Same output as test2, from the C++ reflection backend
+int main()
+{
+    struct ath12k_htt_tx_pdev_stats_cmn_tlv a = {};
+    struct ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv b = {};
+    struct ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv c = {};
+    c.be_ofdma_tx_mcs[3] = 0x01020304;
+    c.gi[1][2] = 7;
+    c.mac_id__word = 0x80000001;
+    struct ath12k_htt_tx_pdev_stats_urrn_tlv d = {};
+    struct ath12k_htt_tx_pdev_stats_flush_tlv e = {};
+    struct ath12k_htt_tx_pdev_stats_phy_err_tlv f = {};
+    d.____dummy = 1;
+    e.____dummy = 2;
+    f.____dummy = 3;
+
+    json_reflect::file_sink sink(stdout);
+    json_reflect::writer<json_reflect::file_sink> w(sink);
+
+    w.put(0, "{\n");
+    w.dump(1, a);
+    w.put(0, ",\n");
+    w.dump(1, b);
+    w.put(0, ",\n");
+    w.dump(1, c);
+    w.put(0, ",\n");
+    w.dump(1, d);
+    w.put(0, ",\n");
+    w.dump(1, e);
+    w.put(0, ",\n");
+    w.dump(1, f);
+    w.put(0, "\n}\n");
+}
@@ -0,0 +1,77 @@
+#ifndef _TEST2_FIXTURE_H_
+#define _TEST2_FIXTURE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <endian.h>
+
+#include "util.h"
+
+// The TLVs that test2 and its backend drivers (test2_*.c) dump, and the JSON
+// document that out2.json holds. Include after test2_input.h and the
+// generated code.
+
+// test2_be is generated with --byte-order big, so its input is big endian
+#ifdef TEST2_BIG_ENDIAN
+#define TEST2_U32(x) htobe32(x)
+#else
+#define TEST2_U32(x) (x)
+#endif
+
+struct test2_tlvs {
+    struct ath12k_htt_tx_pdev_stats_cmn_tlv cmn;
+    struct ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv mu_ppdu;
+    struct ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv ofdma;
+    // same shape, dumped through one shared implementation
+    struct ath12k_htt_tx_pdev_stats_urrn_tlv urrn;
+    struct ath12k_htt_tx_pdev_stats_flush_tlv flush;
+    struct ath12k_htt_tx_pdev_stats_phy_err_tlv phy_err;
+};
+
+static inline void test2_init(struct test2_tlvs *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->ofdma.be_ofdma_tx_mcs[3] = TEST2_U32(0x01020304);
+    t->ofdma.gi[1][2] = TEST2_U32(7);
+    t->ofdma.mac_id__word = TEST2_U32(0x80000001);
+    t->urrn.____dummy = TEST2_U32(1);
+    t->flush.____dummy = TEST2_U32(2);
+    t->phy_err.____dummy = TEST2_U32(3);
+}
+
+// The TLVs are dumped in place from a byte buffer at an odd offset, like in a
+// firmware stats buffer. The code is generated with --unaligned.
+static uint8_t tlv_buf[1 + 4096];
+
+static inline void *at_odd_offset(const void *p, size_t len)
+{
+    assert(len < sizeof(tlv_buf));
+    return memcpy(tlv_buf + 1, p, len);
+}
+
+#define AT_ODD_OFFSET(x) at_odd_offset(&(x), sizeof(x))
+
+// One JSON document with all the TLVs (and the stats with -DJSON_STATS)
+static inline void test2_dump_json(const struct test2_tlvs *t)
+{
+    i_printf(0, "{\n");
+    dump_json_struct_ath12k_htt_tx_pdev_stats_cmn_tlv(1, AT_ODD_OFFSET(t->cmn));
+    i_printf(0, ",\n");
+    dump_json_struct_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv(1, AT_ODD_OFFSET(t->mu_ppdu));
+    i_printf(0, ",\n");
+    dump_json_struct_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(1, AT_ODD_OFFSET(t->ofdma));
+    i_printf(0, ",\n");
+    dump_json_struct_ath12k_htt_tx_pdev_stats_urrn_tlv(1, AT_ODD_OFFSET(t->urrn));
+    i_printf(0, ",\n");
+    dump_json_struct_ath12k_htt_tx_pdev_stats_flush_tlv(1, AT_ODD_OFFSET(t->flush));
+    i_printf(0, ",\n");
+    dump_json_struct_ath12k_htt_tx_pdev_stats_phy_err_tlv(1, AT_ODD_OFFSET(t->phy_err));
+#ifdef JSON_STATS
+    i_printf(0, ",\n");
+    dump_json_stats(1);
+#endif
+    i_printf(0, "\n}\n");
+}
+
+#endif
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include <unistd.h>
+
+#include "util.h"
+#include "json_iov.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// The JSON dump through the writev() sink
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    // A small scratch buffer, so that it fills up and is flushed early
+    if (json_iov_start(STDOUT_FILENO, 64) != 0) {
+        perror("json_iov_start");
+        return 1;
+    }
+    test2_dump_json(&t);
+    if (json_iov_stop() != 0) {
+        perror("json_iov_stop");
+        return 1;
+    }
+
+    return 0;
+}
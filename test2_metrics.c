@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// The TLVs as OpenMetrics text (--openmetrics)
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_stats_cmn_tlv(AT_ODD_OFFSET(t.cmn));
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv(AT_ODD_OFFSET(t.mu_ppdu));
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(AT_ODD_OFFSET(t.ofdma));
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_stats_urrn_tlv(AT_ODD_OFFSET(t.urrn));
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_stats_flush_tlv(AT_ODD_OFFSET(t.flush));
+    dump_openmetrics_struct_ath12k_htt_tx_pdev_stats_phy_err_tlv(AT_ODD_OFFSET(t.phy_err));
+    i_printf(0, "# EOF\n");
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "json_mmap.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// The JSON dump into a memory-mapped file
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s OUTPUT\n", argv[0]);
+        return 1;
+    }
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    // Chunks smaller than the output, so that the mapping moves
+    if (json_mmap_start(argv[1], 1000) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    test2_dump_json(&t);
+    if (json_mmap_stop() != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include "util.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// The schemas and then one record of each TLV (--positional)
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    dump_json_schema_ath12k_htt_tx_pdev_stats_cmn_tlv();
+    dump_json_schema_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv();
+    dump_json_schema_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv();
+    dump_json_schema_ath12k_htt_tx_pdev_stats_urrn_tlv();
+    dump_json_schema_ath12k_htt_tx_pdev_stats_flush_tlv();
+    dump_json_schema_ath12k_htt_tx_pdev_stats_phy_err_tlv();
+    dump_json_records_ath12k_htt_tx_pdev_stats_cmn_tlv(AT_ODD_OFFSET(t.cmn), 1);
+    dump_json_records_ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv(AT_ODD_OFFSET(t.mu_ppdu), 1);
+    dump_json_records_ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv(AT_ODD_OFFSET(t.ofdma), 1);
+    dump_json_records_ath12k_htt_tx_pdev_stats_urrn_tlv(AT_ODD_OFFSET(t.urrn), 1);
+    dump_json_records_ath12k_htt_tx_pdev_stats_flush_tlv(AT_ODD_OFFSET(t.flush), 1);
+    dump_json_records_ath12k_htt_tx_pdev_stats_phy_err_tlv(AT_ODD_OFFSET(t.phy_err), 1);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "util.h"
+#include "json_server.h"
+#include "json_types.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// Serve the TLVs, and request one of them and then all of them over the
+// socket. The second response is the output.
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (argc != 2 || strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "usage: %s SOCKET\n", argv[0]);
+        return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    for (size_t i = 0; i < json_num_types; ++i) {
+        assert(json_type_lookup(json_types[i].name) == &json_types[i]);
+    }
+    for (size_t i = 0; i < json_num_enums; ++i) {
+        assert(json_enum_lookup(json_enums[i].name) == &json_enums[i]);
+    }
+    assert(!json_type_lookup("ath12k_htt_tx_pdev_stats_cmn") && !json_enum_lookup(""));
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    struct json_server *srv = json_server_start(argv[1]);
+    if (!srv) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (json_server_register(srv, "ath12k_htt_tx_pdev_stats_cmn_tlv", AT_ODD_OFFSET(t.cmn), NULL) ||
+        json_server_register(srv, "ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv", &t.mu_ppdu, NULL) ||
+        json_server_register(srv, "ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv", &t.ofdma, NULL) ||
+        json_server_register(srv, "ath12k_htt_tx_pdev_stats_urrn_tlv", &t.urrn, NULL) ||
+        json_server_register(srv, "ath12k_htt_tx_pdev_stats_flush_tlv", &t.flush, NULL) ||
+        json_server_register(srv, "ath12k_htt_tx_pdev_stats_phy_err_tlv", &t.phy_err, NULL)) {
+        perror("json_server_register");
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    static const char req[] = "ath12k_htt_tx_pdev_stats_cmn_tlv\n*\n";
+    if (write(fd, req, sizeof(req) - 1) != sizeof(req) - 1) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // Responses end with a closing brace at the start of a line
+    static char resp[2 * 4096];
+    size_t len = 0;
+    char *second = NULL;
+    while (!second || !strstr(second, "\n}\n")) {
+        ssize_t r = read(fd, resp + len, sizeof(resp) - 1 - len);
+        assert(r > 0);
+        len += r;
+        resp[len] = '\0';
+        char *end = strstr(resp, "\n}\n");
+        second = end ? end + 3 : NULL;
+    }
+    assert(strncmp(resp, "{\n    \"ath12k_htt_tx_pdev_stats_cmn_tlv\": {\n", 42) == 0);
+    fputs(second, stdout);
+    close(fd);
+    json_server_stop(srv);
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <stdarg.h>
+
+#include <sys/mman.h>
+
+#include "util.h"
+#include "json_shm.h"
+#include "test2_input.h"
+#include "test2_out.h"
+#include "test2_fixture.h"
+
+// Publish the TLVs into shared memory, for json_shm_reader
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s SEGMENT\n", argv[0]);
+        return 1;
+    }
+
+    struct test2_tlvs t;
+    test2_init(&t);
+
+    // A segment left by a failed run is replaced
+    shm_unlink(argv[1]);
+    struct json_shm *shm = json_shm_create(argv[1], 6, 4096);
+    if (!shm) {
+        perror(argv[1]);
+        return 1;
+    }
+    int slots[] = {
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_stats_cmn_tlv),
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_mu_ppdu_dist_stats_tlv),
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_rate_stats_be_ofdma_tlv),
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_stats_urrn_tlv),
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_stats_flush_tlv),
+        JSON_SHM_ADD(shm, ath12k_htt_tx_pdev_stats_phy_err_tlv),
+    };
+    for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); ++i) {
+        assert(slots[i] >= 0);
+    }
+    json_shm_publish(shm, slots[0], &t.cmn);
+    json_shm_publish(shm, slots[1], &t.mu_ppdu);
+    json_shm_publish(shm, slots[2], &t.ofdma);
+    json_shm_publish(shm, slots[3], &t.urrn);
+    json_shm_publish(shm, slots[4], &t.flush);
+    json_shm_publish(shm, slots[5], &t.phy_err);
+    json_shm_close(shm);
+
+    return 0;
+}
@@ -24,13 +24,291 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <float.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
 
 #define INDENT_WIDTH 4
 
-bool g_at_col0 = true;
+// Per thread, like the buffers of json_async.c
+__thread bool g_at_col0 = true;
+
+#ifdef JSON_STATS
+__thread uint64_t json_bytes_out;
+#endif
+
+struct sink {
+    json_write_fn write;
+    json_write_fn write_static;
+    void *ctx;
+};
+
+static struct sink g_sink;
+// set by json_set_thread_sink(), overrides g_sink
+static __thread struct sink t_sink;
+
+static inline const struct sink *cur_sink(void)
+{
+    return t_sink.write ? &t_sink : &g_sink;
+}
+
+void json_set_sink(json_write_fn write, void *ctx)
+{
+    g_sink = (struct sink) { .write = write, .ctx = ctx };
+}
+
+void json_set_sink_static(json_write_fn write_static)
+{
+    g_sink.write_static = write_static;
+}
+
+void json_set_thread_sink(json_write_fn write, void *ctx)
+{
+    t_sink = (struct sink) { .write = write, .ctx = ctx };
+}
+
+void json_write(const char *p, size_t n)
+{
+    const struct sink *k = cur_sink();
+
+    if (k->write) {
+        k->write(k->ctx, p, n);
+    } else {
+        fwrite(p, 1, n, stdout);
+    }
+}
+
+// vprintf() into the sink
+static int sink_vprintf(const struct sink *k, const char *format, va_list args)
+{
+    char buf[512];
+    va_list copy;
+
+    va_copy(copy, args);
+    int r = vsnprintf(buf, sizeof(buf), format, copy);
+    va_end(copy);
+
+    if (r < 0) {
+        return r;
+    }
+    if ((size_t) r < sizeof(buf)) {
+        k->write(k->ctx, buf, r);
+        return r;
+    }
+
+    char *p = malloc(r + 1);
+    assert(p);
+    vsnprintf(p, r + 1, format, args);
+    k->write(k->ctx, p, r);
+    free(p);
+
+    return r;
+}
+
+static const char g_spaces[64] =
+    "                                                                ";
+
+static void write_static_indent(const struct sink *k, uint32_t indent)
+{
+    size_t n = (size_t) indent * INDENT_WIDTH;
+
+    while (n) {
+        size_t chunk = n < sizeof(g_spaces) ? n : sizeof(g_spaces);
+        k->write_static(k->ctx, g_spaces, chunk);
+        n -= chunk;
+    }
+}
+
+// Format the single conversion spec of spec_len chars at spec (e.g. "%08lx")
+// into the sink, taking its arguments from args
+static int sink_convert(const struct sink *k, const char *spec, size_t spec_len, va_list *args)
+{
+    char fmt[32];
+    char buf[128];
+    // values of '*' widths and precisions, in order
+    int stars[2];
+    int num_stars = 0;
+    int r;
+
+    if (spec_len >= sizeof(fmt)) {
+        return -1;
+    }
+    memcpy(fmt, spec, spec_len);
+    fmt[spec_len] = '\0';
+
+    for (size_t i = 1; i < spec_len; ++i) {
+        if (spec[i] == '*') {
+            if (num_stars == 2) {
+                return -1;
+            }
+            stars[num_stars++] = va_arg(*args, int);
+        }
+    }
+
+    char conv = spec[spec_len - 1];
+    const char *len_mod = spec + spec_len - 1;
+    while (len_mod > spec && strchr("hljztL", len_mod[-1])) {
+        len_mod--;
+    }
+    size_t mod_len = (size_t) (spec + spec_len - 1 - len_mod);
+
+#define SINK_SNPRINTF(type) do { \
+    type v = va_arg(*args, type); \
+    if (num_stars == 2) { \
+        r = snprintf(buf, sizeof(buf), fmt, stars[0], stars[1], v); \
+    } else if (num_stars == 1) { \
+        r = snprintf(buf, sizeof(buf), fmt, stars[0], v); \
+    } else { \
+        r = snprintf(buf, sizeof(buf), fmt, v); \
+    } \
+} while (0)
+
+    switch (conv) {
+    case 'd':
+    case 'i':
+        if (mod_len == 2 && len_mod[0] == 'l') {
+            SINK_SNPRINTF(long long);
+        } else if (mod_len && (len_mod[0] == 'l' || len_mod[0] == 'z' || len_mod[0] == 't')) {
+            SINK_SNPRINTF(long);
+        } else if (mod_len && len_mod[0] == 'j') {
+            SINK_SNPRINTF(intmax_t);
+        } else {
+            SINK_SNPRINTF(int);
+        }
+        break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        if (mod_len == 2 && len_mod[0] == 'l') {
+            SINK_SNPRINTF(unsigned long long);
+        } else if (mod_len && (len_mod[0] == 'l' || len_mod[0] == 'z' || len_mod[0] == 't')) {
+            SINK_SNPRINTF(unsigned long);
+        } else if (mod_len && len_mod[0] == 'j') {
+            SINK_SNPRINTF(uintmax_t);
+        } else {
+            SINK_SNPRINTF(unsigned);
+        }
+        break;
+    case 'c':
+        SINK_SNPRINTF(int);
+        break;
+    case 'p':
+        SINK_SNPRINTF(void *);
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        if (mod_len && len_mod[0] == 'L') {
+            SINK_SNPRINTF(long double);
+        } else {
+            SINK_SNPRINTF(double);
+        }
+        break;
+    case 's':
+        if (spec_len == 2) {
+            // the common case, written as is
+            const char *str = va_arg(*args, const char *);
+            size_t n = strlen(str);
+            k->write(k->ctx, str, n);
+            return (int) n;
+        }
+        SINK_SNPRINTF(const char *);
+        break;
+    default:
+        return -1;
+    }
+#undef SINK_SNPRINTF
+
+    if (r < 0 || (size_t) r >= sizeof(buf)) {
+        return -1;
+    }
+    k->write(k->ctx, buf, r);
+
+    return r;
+}
+
+// i_printf() into a sink taking static text by reference: the literal text of
+// the format and the indentation are passed to write_static(), only the
+// converted arguments are formatted.
+static int sink_static_printf(const struct sink *k, uint32_t indent, const char *format, va_list args)
+{
+    const char *p = format;
+    int total = 0;
+    va_list ap;
+
+    va_copy(ap, args);
+
+    while (*p) {
+        if (g_at_col0) {
+            write_static_indent(k, indent);
+            total += indent * INDENT_WIDTH;
+            g_at_col0 = false;
+        }
+
+        if (*p == '%' && p[1] != '%') {
+            size_t n = 1 + strspn(p + 1, "-+ #0123456789.*hljztL");
+            if (p[n] == '\0') {
+                total = -1;
+                break;
+            }
+            n++;
+            int r = sink_convert(k, p, n, &ap);
+            if (r < 0) {
+                total = -1;
+                break;
+            }
+            total += r;
+            p += n;
+            continue;
+        }
+
+        // literal text up to the end of the line or the next conversion
+        const char *start = p;
+        if (*p == '%') {
+            // "%%", written as the second '%'
+            start = ++p;
+        }
+        p++;
+        while (*p && *p != '%' && p[-1] != '\n') {
+            p++;
+        }
+        k->write_static(k->ctx, start, (size_t) (p - start));
+        total += (int) (p - start);
+        g_at_col0 = (p[-1] == '\n');
+    }
+
+    va_end(ap);
+
+    return total;
+}
 
 int i_printf(uint32_t indent, const char *restrict format, ...)
 {
+    const struct sink *k = cur_sink();
+
+    if (k->write_static) {
+        va_list args;
+        va_start(args, format);
+        int r = sink_static_printf(k, indent, format, args);
+        va_end(args);
+#ifdef JSON_STATS
+        if (r > 0) {
+            json_bytes_out += r;
+        }
+#endif
+        return r;
+    }
+
     size_t len = strlen(format);
     size_t num_newlines = 0;
 
@@ -66,9 +344,15 @@ int i_printf(uint32_t indent, const char *restrict format, ...)
 
     va_list args;
     va_start(args, format);
-    int r = vprintf(new_fmt, args);
+    int r = k->write ? sink_vprintf(k, new_fmt, args) : vprintf(new_fmt, args);
     va_end(args);
 
+#ifdef JSON_STATS
+    if (r > 0) {
+        json_bytes_out += r;
+    }
+#endif
+
     if (allocated_new_fmt) {
 //        printf("old fmt string: \"%s\", new fmt string: \"%s\"\n",
 //            format, new_fmt);
@@ -78,3 +362,724 @@ int i_printf(uint32_t indent, const char *restrict format, ...)
 
     return r;
 }
+
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Decimal digits of v at p, returns the end
+char *json_format_u64(char *p, uint64_t v)
+{
+    char tmp[20];
+    char *t = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        t -= 2;
+        memcpy(t, digit_pairs + 2 * (v % 100), 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        t -= 2;
+        memcpy(t, digit_pairs + 2 * v, 2);
+    } else {
+        *--t = (char) ('0' + v);
+    }
+
+    size_t n = (size_t) (tmp + sizeof(tmp) - t);
+    memcpy(p, t, n);
+    return p + n;
+}
+
+char *json_format_i64(char *p, int64_t v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        // no overflow for INT64_MIN
+        return json_format_u64(p, (uint64_t) -(v + 1) + 1);
+    }
+
+    return json_format_u64(p, (uint64_t) v);
+}
+
+#define BSWAP8(x) (x)
+
+// Each element is loaded as utype and, with swap, byte swapped in the
+// register, so swapped arrays need no converted copy
+#define FORMAT_INT_ARRAY(type, utype, format, bswap) do { \
+    for (size_t i = 0; i < n; ++i) { \
+        utype u; \
+        if (len > sizeof(buf) - 24) { \
+            json_write(buf, len); \
+            out += len; \
+            len = 0; \
+        } \
+        if (i != 0) { \
+            buf[len++] = ','; \
+            buf[len++] = ' '; \
+        } \
+        memcpy(&u, p + i * sizeof(utype), sizeof(utype)); \
+        if (swap) { \
+            u = bswap(u); \
+        } \
+        len = (size_t) (format(buf + len, (type) u) - buf); \
+    } \
+} while (0)
+
+static inline void print_int_array(const void *a, size_t n, size_t width, bool is_signed, bool swap)
+{
+    const uint8_t *p = a;
+    char buf[512];
+    size_t len = 0;
+    size_t out = 0;
+
+    switch (width * 2 + is_signed) {
+    case 2:
+        FORMAT_INT_ARRAY(uint8_t, uint8_t, json_format_u64, BSWAP8);
+        break;
+    case 3:
+        FORMAT_INT_ARRAY(int8_t, uint8_t, json_format_i64, BSWAP8);
+        break;
+    case 4:
+        FORMAT_INT_ARRAY(uint16_t, uint16_t, json_format_u64, __builtin_bswap16);
+        break;
+    case 5:
+        FORMAT_INT_ARRAY(int16_t, uint16_t, json_format_i64, __builtin_bswap16);
+        break;
+    case 8:
+        FORMAT_INT_ARRAY(uint32_t, uint32_t, json_format_u64, __builtin_bswap32);
+        break;
+    case 9:
+        FORMAT_INT_ARRAY(int32_t, uint32_t, json_format_i64, __builtin_bswap32);
+        break;
+    case 16:
+        FORMAT_INT_ARRAY(uint64_t, uint64_t, json_format_u64, __builtin_bswap64);
+        break;
+    case 17:
+        FORMAT_INT_ARRAY(int64_t, uint64_t, json_format_i64, __builtin_bswap64);
+        break;
+    default:
+        assert(0);
+    }
+
+    json_write(buf, len);
+    out += len;
+#ifdef JSON_STATS
+    json_bytes_out += out;
+#else
+    (void) out;
+#endif
+}
+
+// Print the n integers of width bytes at a (at any alignment) separated by
+// ", ", formatted into a buffer and written at once instead of one printf()
+// per element
+void json_print_int_array(const void *a, size_t n, size_t width, bool is_signed)
+{
+    print_int_array(a, n, width, is_signed, false);
+}
+
+// The same for integers in the other byte order
+void json_print_int_array_bswap(const void *a, size_t n, size_t width, bool is_signed)
+{
+    print_int_array(a, n, width, is_signed, true);
+}
+
+// Length of the prefix of the n chars at s that can be copied into a JSON
+// string as is: up to the first control character (including NUL), quote or
+// backslash. 16 chars are checked at a time where SSE2 is available.
+static size_t json_clean_prefix(const char *s, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i max_ctrl = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        // unsigned v <= 0x1f
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, max_ctrl), v);
+        __m128i special = _mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + (size_t) __builtin_ctz((unsigned) mask);
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        unsigned char c = (unsigned char) s[i];
+        if (c < 0x20 || c == '"' || c == '\\') {
+            break;
+        }
+    }
+
+    return i;
+}
+
+// Escape sequence of c, a char that json_clean_prefix() stops at, in esc.
+// Returns its length.
+static size_t json_escape(char esc[6], unsigned char c)
+{
+    static const char short_escapes[0x20] = {
+        ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', ['\f'] = 'f', ['\r'] = 'r',
+    };
+
+    esc[0] = '\\';
+    esc[1] = (char) c;
+    if (c >= 0x20) {
+        return 2;
+    }
+    if (short_escapes[c]) {
+        esc[1] = short_escapes[c];
+        return 2;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    memcpy(esc + 1, "u00", 3);
+    esc[4] = hex[c >> 4];
+    esc[5] = hex[c & 0xf];
+    return 6;
+}
+
+// Print the n chars at s, up to the first NUL, as a JSON string. Runs of
+// chars that need no escaping are written as a whole. Bytes from 0x80 up are
+// copied, so UTF-8 text stays as it is.
+void json_print_string(uint32_t indent, const char *s, size_t n)
+{
+    size_t i = 0;
+#ifdef JSON_STATS
+    size_t out = 0;
+#endif
+
+    // the opening quote goes through i_printf() for the indentation
+    i_printf(indent, "\"");
+
+    for (;;) {
+        size_t run = json_clean_prefix(s + i, n - i);
+        json_write(s + i, run);
+        i += run;
+#ifdef JSON_STATS
+        out += run;
+#endif
+        if (i == n || s[i] == '\0') {
+            break;
+        }
+
+        char esc[6];
+        size_t len = json_escape(esc, (unsigned char) s[i++]);
+        json_write(esc, len);
+#ifdef JSON_STATS
+        out += len;
+#endif
+    }
+
+#ifdef JSON_STATS
+    json_bytes_out += out;
+#endif
+    i_printf(indent, "\"");
+}
+
+// Shortest round-trip formatting of floating point members, with Grisu3
+// (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers", PLDI 2010). Grisu3 finds the shortest digits that read back as
+// the same value for all but ~0.5% of the inputs, and detects when it can
+// not, in which case the digits are searched with snprintf() instead.
+
+// f * 2^e
+struct diy_fp {
+    uint64_t f;
+    int e;
+};
+
+// Normalized 64 bit approximations of 10^k, k = -348, -340, ..., 340
+static const struct {
+    uint64_t f;
+    int16_t e;
+    int16_t k;
+} cached_powers[] = {
+    { 0xfa8fd5a0081c0288ull, -1220, -348 },
+    { 0xbaaee17fa23ebf76ull, -1193, -340 },
+    { 0x8b16fb203055ac76ull, -1166, -332 },
+    { 0xcf42894a5dce35eaull, -1140, -324 },
+    { 0x9a6bb0aa55653b2dull, -1113, -316 },
+    { 0xe61acf033d1a45dfull, -1087, -308 },
+    { 0xab70fe17c79ac6caull, -1060, -300 },
+    { 0xff77b1fcbebcdc4full, -1034, -292 },
+    { 0xbe5691ef416bd60cull, -1007, -284 },
+    { 0x8dd01fad907ffc3cull, -980, -276 },
+    { 0xd3515c2831559a83ull, -954, -268 },
+    { 0x9d71ac8fada6c9b5ull, -927, -260 },
+    { 0xea9c227723ee8bcbull, -901, -252 },
+    { 0xaecc49914078536dull, -874, -244 },
+    { 0x823c12795db6ce57ull, -847, -236 },
+    { 0xc21094364dfb5637ull, -821, -228 },
+    { 0x9096ea6f3848984full, -794, -220 },
+    { 0xd77485cb25823ac7ull, -768, -212 },
+    { 0xa086cfcd97bf97f4ull, -741, -204 },
+    { 0xef340a98172aace5ull, -715, -196 },
+    { 0xb23867fb2a35b28eull, -688, -188 },
+    { 0x84c8d4dfd2c63f3bull, -661, -180 },
+    { 0xc5dd44271ad3cdbaull, -635, -172 },
+    { 0x936b9fcebb25c996ull, -608, -164 },
+    { 0xdbac6c247d62a584ull, -582, -156 },
+    { 0xa3ab66580d5fdaf6ull, -555, -148 },
+    { 0xf3e2f893dec3f126ull, -529, -140 },
+    { 0xb5b5ada8aaff80b8ull, -502, -132 },
+    { 0x87625f056c7c4a8bull, -475, -124 },
+    { 0xc9bcff6034c13053ull, -449, -116 },
+    { 0x964e858c91ba2655ull, -422, -108 },
+    { 0xdff9772470297ebdull, -396, -100 },
+    { 0xa6dfbd9fb8e5b88full, -369, -92 },
+    { 0xf8a95fcf88747d94ull, -343, -84 },
+    { 0xb94470938fa89bcfull, -316, -76 },
+    { 0x8a08f0f8bf0f156bull, -289, -68 },
+    { 0xcdb02555653131b6ull, -263, -60 },
+    { 0x993fe2c6d07b7facull, -236, -52 },
+    { 0xe45c10c42a2b3b06ull, -210, -44 },
+    { 0xaa242499697392d3ull, -183, -36 },
+    { 0xfd87b5f28300ca0eull, -157, -28 },
+    { 0xbce5086492111aebull, -130, -20 },
+    { 0x8cbccc096f5088ccull, -103, -12 },
+    { 0xd1b71758e219652cull, -77, -4 },
+    { 0x9c40000000000000ull, -50, 4 },
+    { 0xe8d4a51000000000ull, -24, 12 },
+    { 0xad78ebc5ac620000ull, 3, 20 },
+    { 0x813f3978f8940984ull, 30, 28 },
+    { 0xc097ce7bc90715b3ull, 56, 36 },
+    { 0x8f7e32ce7bea5c70ull, 83, 44 },
+    { 0xd5d238a4abe98068ull, 109, 52 },
+    { 0x9f4f2726179a2245ull, 136, 60 },
+    { 0xed63a231d4c4fb27ull, 162, 68 },
+    { 0xb0de65388cc8ada8ull, 189, 76 },
+    { 0x83c7088e1aab65dbull, 216, 84 },
+    { 0xc45d1df942711d9aull, 242, 92 },
+    { 0x924d692ca61be758ull, 269, 100 },
+    { 0xda01ee641a708deaull, 295, 108 },
+    { 0xa26da3999aef774aull, 322, 116 },
+    { 0xf209787bb47d6b85ull, 348, 124 },
+    { 0xb454e4a179dd1877ull, 375, 132 },
+    { 0x865b86925b9bc5c2ull, 402, 140 },
+    { 0xc83553c5c8965d3dull, 428, 148 },
+    { 0x952ab45cfa97a0b3ull, 455, 156 },
+    { 0xde469fbd99a05fe3ull, 481, 164 },
+    { 0xa59bc234db398c25ull, 508, 172 },
+    { 0xf6c69a72a3989f5cull, 534, 180 },
+    { 0xb7dcbf5354e9beceull, 561, 188 },
+    { 0x88fcf317f22241e2ull, 588, 196 },
+    { 0xcc20ce9bd35c78a5ull, 614, 204 },
+    { 0x98165af37b2153dfull, 641, 212 },
+    { 0xe2a0b5dc971f303aull, 667, 220 },
+    { 0xa8d9d1535ce3b396ull, 694, 228 },
+    { 0xfb9b7cd9a4a7443cull, 720, 236 },
+    { 0xbb764c4ca7a44410ull, 747, 244 },
+    { 0x8bab8eefb6409c1aull, 774, 252 },
+    { 0xd01fef10a657842cull, 800, 260 },
+    { 0x9b10a4e5e9913129ull, 827, 268 },
+    { 0xe7109bfba19c0c9dull, 853, 276 },
+    { 0xac2820d9623bf429ull, 880, 284 },
+    { 0x80444b5e7aa7cf85ull, 907, 292 },
+    { 0xbf21e44003acdd2dull, 933, 300 },
+    { 0x8e679c2f5e44ff8full, 960, 308 },
+    { 0xd433179d9c8cb841ull, 986, 316 },
+    { 0x9e19db92b4e31ba9ull, 1013, 324 },
+    { 0xeb96bf6ebadf77d9ull, 1039, 332 },
+    { 0xaf87023b9bf0ee6bull, 1066, 340 },
+};
+
+#define CACHED_POWERS_MIN_K (-348)
+#define CACHED_POWERS_K_STEP 8
+
+// Range of the binary exponent of the scaled values, so that the integral
+// part of a scaled value fits in 32 bits
+#define GRISU_MIN_EXP (-60)
+#define GRISU_MAX_EXP (-32)
+
+static struct diy_fp diy_fp_mul(struct diy_fp a, struct diy_fp b)
+{
+    unsigned __int128 p = (unsigned __int128) a.f * b.f;
+    // round the lower 64 bits
+    struct diy_fp r = { (uint64_t) (p >> 64) + ((uint64_t) p >> 63), a.e + b.e + 64 };
+
+    return r;
+}
+
+static struct diy_fp diy_fp_normalize(struct diy_fp a)
+{
+    int shift = __builtin_clzll(a.f);
+    struct diy_fp r = { a.f << shift, a.e - shift };
+
+    return r;
+}
+
+// The cached power c = 10^-k such that the binary exponent of w * c is in
+// [GRISU_MIN_EXP, GRISU_MAX_EXP]
+static struct diy_fp cached_power(int e, int *k)
+{
+    int min_exp = GRISU_MIN_EXP - (e + 64);
+    // ceil(log10(2^(min_exp + 63)))
+    int dk = (int) ((min_exp + 63) * 0.30102999566398114);
+    if ((min_exp + 63) * 0.30102999566398114 > dk) {
+        dk++;
+    }
+    int idx = (-CACHED_POWERS_MIN_K + dk - 1) / CACHED_POWERS_K_STEP + 1;
+    struct diy_fp c = { cached_powers[idx].f, cached_powers[idx].e };
+
+    *k = -cached_powers[idx].k;
+    return c;
+}
+
+static const uint32_t pow10_u32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// Move the last digit of buf towards w while that is safe. Returns whether
+// the digits are the shortest and correctly rounded.
+static bool grisu_round_weed(char *buf, int len, uint64_t dist_high_w, uint64_t unsafe_interval,
+    uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+    uint64_t small_dist = dist_high_w - unit;
+    uint64_t big_dist = dist_high_w + unit;
+
+    while (rest < small_dist && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_dist || small_dist - rest >= rest + ten_kappa - small_dist)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+
+    if (rest < big_dist && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_dist || big_dist - rest > rest + ten_kappa - big_dist)) {
+        return false;
+    }
+
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Generate the shortest digits of a number in (low, high), scaled by the
+// cached power, closest to w. The number is buf * 10^kappa.
+static bool grisu_digit_gen(struct diy_fp low, struct diy_fp w, struct diy_fp high, char *buf, int *len, int *kappa)
+{
+    uint64_t unit = 1;
+    struct diy_fp too_low = { low.f - unit, low.e };
+    struct diy_fp too_high = { high.f + unit, high.e };
+    uint64_t unsafe_interval = too_high.f - too_low.f;
+    int shift = -w.e;
+    uint64_t one = (uint64_t) 1 << shift;
+    uint32_t integrals = (uint32_t) (too_high.f >> shift);
+    uint64_t fractionals = too_high.f & (one - 1);
+
+    // the digits of the integral part, least significant first, with
+    // divisions by a constant instead of by the current power of ten
+    uint8_t int_digits[10];
+    int k = 0;
+    for (uint32_t n = integrals; n; n /= 10) {
+        int_digits[k++] = (uint8_t) (n % 10);
+    }
+    *kappa = k;
+    *len = 0;
+
+    while (*kappa > 0) {
+        uint32_t divisor = pow10_u32[*kappa - 1];
+        uint8_t digit = int_digits[*kappa - 1];
+        buf[(*len)++] = (char) ('0' + digit);
+        integrals -= digit * divisor;
+        (*kappa)--;
+
+        uint64_t rest = ((uint64_t) integrals << shift) + fractionals;
+        if (rest < unsafe_interval) {
+            return grisu_round_weed(buf, *len, too_high.f - w.f, unsafe_interval, rest, (uint64_t) divisor << shift, unit);
+        }
+    }
+
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        buf[(*len)++] = (char) ('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        (*kappa)--;
+
+        if (fractionals < unsafe_interval) {
+            return grisu_round_weed(buf, *len, (too_high.f - w.f) * unit, unsafe_interval, fractionals, one, unit);
+        }
+    }
+}
+
+// The value f * 2^e, with the neighbouring floating point values half way to
+// the boundaries. lower_closer is set when f is a power of two, where the
+// lower neighbour is closer. The value is buf * 10^dec_exp.
+static bool grisu3(uint64_t f, int e, bool lower_closer, char *buf, int *len, int *dec_exp)
+{
+    struct diy_fp w = diy_fp_normalize((struct diy_fp) { f, e });
+    struct diy_fp plus = diy_fp_normalize((struct diy_fp) { (f << 1) + 1, e - 1 });
+    struct diy_fp minus = lower_closer ? (struct diy_fp) { (f << 2) - 1, e - 2 } : (struct diy_fp) { (f << 1) - 1, e - 1 };
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    int k;
+    struct diy_fp c = cached_power(w.e, &k);
+    int kappa;
+
+    bool ok = grisu_digit_gen(diy_fp_mul(minus, c), diy_fp_mul(w, c), diy_fp_mul(plus, c), buf, len, &kappa);
+    *dec_exp = k + kappa;
+
+    return ok;
+}
+
+// Fallback: the shortest %e precision that reads back as v. The value is
+// buf * 10^dec_exp. Every decimal of up to DIG digits reads back as itself,
+// so when a shorter one is the shortest, it is the DIG digit one without its
+// trailing zeros.
+static void shortest_printf(double v, bool single, char *buf, int *len, int *dec_exp)
+{
+    char tmp[32];
+
+    for (int prec = single ? FLT_DIG : DBL_DIG; prec <= 17; ++prec) {
+        snprintf(tmp, sizeof(tmp), "%.*e", prec - 1, v);
+        if (single ? strtof(tmp, NULL) == (float) v : strtod(tmp, NULL) == v) {
+            break;
+        }
+    }
+
+    int n = 0;
+    const char *p = tmp;
+    for (; *p != 'e'; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            buf[n++] = *p;
+        }
+    }
+    while (n > 1 && buf[n - 1] == '0') {
+        n--;
+    }
+    *len = n;
+    *dec_exp = atoi(p + 1) - (n - 1);
+}
+
+// Lay out the digits like Python's repr(): positional notation for decimal
+// exponents in [-4, 16), 1.5e-05 style otherwise, and always with a fraction
+// or an exponent.
+static char *format_digits(char *out, bool negative, const char *digits, int len, int dec_exp)
+{
+    char *p = out;
+    int x = len + dec_exp - 1;
+
+    if (negative) {
+        *p++ = '-';
+    }
+
+    if (x < -4 || x >= 16) {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        p += sprintf(p, "e%c%02d", x < 0 ? '-' : '+', x < 0 ? -x : x);
+    } else if (x < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > x; --i) {
+            *p++ = '0';
+        }
+        memcpy(p, digits, len);
+        p += len;
+        *p = '\0';
+    } else {
+        for (int i = 0; i <= x; ++i) {
+            *p++ = i < len ? digits[i] : '0';
+        }
+        *p++ = '.';
+        if (len > x + 1) {
+            memcpy(p, digits + x + 1, len - x - 1);
+            p += len - x - 1;
+        } else {
+            *p++ = '0';
+        }
+        *p = '\0';
+    }
+
+    return out;
+}
+
+// NaN and the infinities have no JSON representation and become null
+char *json_format_double(char *buf, double v)
+{
+    uint64_t bits;
+    char digits[20];
+    int len, dec_exp;
+
+    memcpy(&bits, &v, sizeof(bits));
+    bool negative = bits >> 63;
+    int biased = (int) (bits >> 52) & 0x7ff;
+    uint64_t frac = bits & (((uint64_t) 1 << 52) - 1);
+
+    if (biased == 0x7ff) {
+        return strcpy(buf, "null");
+    }
+    if (biased == 0 && frac == 0) {
+        return strcpy(buf, negative ? "-0.0" : "0.0");
+    }
+
+    uint64_t f = biased ? frac | ((uint64_t) 1 << 52) : frac;
+    int e = (biased ? biased : 1) - 1075;
+
+    if (!grisu3(f, e, frac == 0 && biased > 1, digits, &len, &dec_exp)) {
+        shortest_printf(negative ? -v : v, false, digits, &len, &dec_exp);
+    }
+
+    return format_digits(buf, negative, digits, len, dec_exp);
+}
+
+char *json_format_float(char *buf, float v)
+{
+    uint32_t bits;
+    char digits[20];
+    int len, dec_exp;
+
+    memcpy(&bits, &v, sizeof(bits));
+    bool negative = bits >> 31;
+    int biased = (int) (bits >> 23) & 0xff;
+    uint32_t frac = bits & ((1u << 23) - 1);
+
+    if (biased == 0xff) {
+        return strcpy(buf, "null");
+    }
+    if (biased == 0 && frac == 0) {
+        return strcpy(buf, negative ? "-0.0" : "0.0");
+    }
+
+    uint64_t f = biased ? frac | (1u << 23) : frac;
+    int e = (biased ? biased : 1) - 150;
+
+    if (!grisu3(f, e, frac == 0 && biased > 1, digits, &len, &dec_exp)) {
+        shortest_printf(negative ? -v : v, true, digits, &len, &dec_exp);
+    }
+
+    return format_digits(buf, negative, digits, len, dec_exp);
+}
+
+char *json_format_metric_double(char *buf, double v)
+{
+    if (__builtin_isnan(v)) {
+        return strcpy(buf, "NaN");
+    }
+    if (__builtin_isinf(v)) {
+        return strcpy(buf, v < 0 ? "-Inf" : "+Inf");
+    }
+
+    return json_format_double(buf, v);
+}
+
+char *json_format_metric_float(char *buf, float v)
+{
+    if (__builtin_isnan(v)) {
+        return strcpy(buf, "NaN");
+    }
+    if (__builtin_isinf(v)) {
+        return strcpy(buf, v < 0 ? "-Inf" : "+Inf");
+    }
+
+    return json_format_float(buf, v);
+}
+
+#define BATCH_SIZE (64 * 1024)
+
+// The batch buffer of the calling thread, allocated on first use
+static __thread char *t_batch;
+static __thread size_t t_batch_len;
+static __thread size_t t_batch_cap;
+
+char *json_batch_begin(size_t max_len)
+{
+    if (t_batch_len + max_len > t_batch_cap) {
+        json_batch_flush();
+    }
+
+    if (max_len > t_batch_cap) {
+        // rows longer than a batch get a buffer to themselves
+        t_batch_cap = max_len > BATCH_SIZE ? max_len : BATCH_SIZE;
+        free(t_batch);
+        t_batch = malloc(t_batch_cap);
+        assert(t_batch);
+    }
+
+    return t_batch + t_batch_len;
+}
+
+void json_batch_end(char *end)
+{
+    t_batch_len = (size_t) (end - t_batch);
+    assert(t_batch_len <= t_batch_cap);
+}
+
+void json_batch_flush(void)
+{
+    if (t_batch_len) {
+        json_write(t_batch, t_batch_len);
+        t_batch_len = 0;
+    }
+}
+
+void json_csv_header(const char *header, size_t len, char sep)
+{
+    char buf[4096];
+
+    while (len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = header[i] == ',' ? sep : header[i];
+        }
+        json_write(buf, n);
+        header += n;
+        len -= n;
+    }
+}
+
+char *json_csv_double(char *p, double v)
+{
+    json_format_metric_double(p, v);
+    return p + strlen(p);
+}
+
+char *json_csv_float(char *p, float v)
+{
+    json_format_metric_float(p, v);
+    return p + strlen(p);
+}
+
+char *json_batch_string(char *p, const char *s, size_t n)
+{
+    size_t i = 0;
+
+    *p++ = '"';
+    for (;;) {
+        size_t run = json_clean_prefix(s + i, n - i);
+        memcpy(p, s + i, run);
+        p += run;
+        i += run;
+        if (i == n || s[i] == '\0') {
+            break;
+        }
+        p += json_escape(p, (unsigned char) s[i++]);
+    }
+    *p++ = '"';
+
+    return p;
+}
+
+char *json_batch_double(char *p, double v)
+{
+    json_format_double(p, v);
+    return p + strlen(p);
+}
+
+char *json_batch_float(char *p, float v)
+{
+    json_format_float(p, v);
+    return p + strlen(p);
+}
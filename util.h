@@ -2,7 +2,160 @@
 #define _UTIL_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 int i_printf(uint32_t indent, const char *restrict format, ...);
+void json_print_string(uint32_t indent, const char *s, size_t n);
+void json_print_int_array(const void *a, size_t n, size_t width, bool is_signed);
+void json_print_int_array_bswap(const void *a, size_t n, size_t width, bool is_signed);
+
+// All output of the functions above goes to stdout, unless a sink is set with
+// json_set_sink(): then write(ctx, p, n) is called with every piece of output,
+// on the dumping thread. json_set_sink(NULL, NULL) restores stdout.
+typedef void (*json_write_fn)(void *ctx, const char *p, size_t n);
+
+void json_set_sink(json_write_fn write, void *ctx);
+// Optionally, write_static(ctx, p, n) is called instead of write for text that
+// stays valid and unchanged for the life of the program (the literal text of
+// i_printf() formats and the indentation), which the sink may keep a pointer
+// to rather than copy. Set after json_set_sink().
+void json_set_sink_static(json_write_fn write_static);
+
+// Sink of the calling thread only, taking precedence over json_set_sink(),
+// e.g. for a server thread dumping into its own buffers.
+// json_set_thread_sink(NULL, NULL) removes it.
+void json_set_thread_sink(json_write_fn write, void *ctx);
+void json_write(const char *p, size_t n);
+
+// The member of the struct type at p. Generated code shared between structs of
+// the same layout accesses members this way, through an lvalue of the
+// member's own type rather than one of a different struct type.
+#define JSON_MEMBER(type, p, member) \
+    (*(__typeof__(((type *) 0)->member) *) ((char *) (p) + offsetof(type, member)))
+
+// Member of the struct type at p, which may be at any alignment (packed
+// structs or structs generated with --unaligned), loaded by value. The copy
+// compiles to a single unaligned load where the target has one.
+#define JSON_LOAD_UNALIGNED(type, p, member) (__extension__ ({ \
+    __typeof__(((type *) 0)->member) _json_v; \
+    __builtin_memcpy(&_json_v, (const char *) (p) + offsetof(type, member), sizeof(_json_v)); \
+    _json_v; }))
+
+// Floating point members are formatted as the shortest decimal that reads back
+// as the same value, e.g. 0.1, 1e+100, NaN and infinities as null. A buffer
+// of JSON_FLOAT_BUF_SIZE bytes fits any value.
+#define JSON_FLOAT_BUF_SIZE 32
+
+char *json_format_double(char *buf, double v);
+char *json_format_float(char *buf, float v);
+
+// Formatted member value for a printf %s, in a temporary buffer
+#define JSON_FORMAT_DOUBLE(v) json_format_double((char [JSON_FLOAT_BUF_SIZE]) { 0 }, (v))
+#define JSON_FORMAT_FLOAT(v) json_format_float((char [JSON_FLOAT_BUF_SIZE]) { 0 }, (v))
+
+// The same for OpenMetrics samples, which have NaN, +Inf and -Inf
+char *json_format_metric_double(char *buf, double v);
+char *json_format_metric_float(char *buf, float v);
+
+#define JSON_FORMAT_METRIC_DOUBLE(v) json_format_metric_double((char [JSON_FLOAT_BUF_SIZE]) { 0 }, (v))
+#define JSON_FORMAT_METRIC_FLOAT(v) json_format_metric_float((char [JSON_FLOAT_BUF_SIZE]) { 0 }, (v))
+
+// Runtime of the row functions generated with --csv and --positional. Rows
+// are formatted into a per-thread batch buffer, which is written with
+// json_write() when the next row may not fit, and at the end of every call of
+// a generated function.
+//
+// json_batch_begin() returns where a row of at most max_len bytes starts in
+// the batch buffer, json_batch_end() ends it at end.
+char *json_batch_begin(size_t max_len);
+void json_batch_end(char *end);
+void json_batch_flush(void);
+
+// The n chars at s, up to the first NUL, as a JSON string at p, as by
+// json_print_string(). Returns the end, at most 6 * n + 2 bytes are written.
+char *json_batch_string(char *p, const char *s, size_t n);
+
+// Floating point value at p as by json_format_double(), returns the end. At
+// most JSON_FLOAT_BUF_SIZE bytes are written, including a NUL which is not
+// part of the value.
+char *json_batch_double(char *p, double v);
+char *json_batch_float(char *p, float v);
+
+// Write header, len bytes of comma separated column names, with the commas
+// replaced by sep
+void json_csv_header(const char *header, size_t len, char sep);
+
+// Floating point value at p as by json_format_metric_double(), returns the
+// end. At most JSON_FLOAT_BUF_SIZE bytes are written, including a NUL which
+// is not part of the value.
+char *json_csv_double(char *p, double v);
+char *json_csv_float(char *p, float v);
+
+// Decimal digits of integer v at p, returns the end. At most 20 bytes are
+// written, no NUL.
+char *json_format_u64(char *p, uint64_t v);
+char *json_format_i64(char *p, int64_t v);
+
+// Byte order conversion of the members of structs generated with
+// --byte-order or --struct-byte-order. JSON_LOAD_LE/BE(x) is integer member x,
+// stored little/big endian, in host byte order. JSON_LOAD_LE/BE_FLOAT/DOUBLE(p)
+// is the floating point member at p (at any alignment), loaded as an integer
+// of the same size and swapped before it becomes a floating point value.
+//
+// JSON_PRINT_INT_ARRAY_LE/BE is json_print_int_array() for an array stored
+// little/big endian, whose elements are swapped as they are formatted.
+#define JSON_BSWAP(x) ((__typeof__(x)) \
+    (sizeof(x) == 2 ? __builtin_bswap16((uint16_t) (x)) : \
+     sizeof(x) == 4 ? __builtin_bswap32((uint32_t) (x)) : \
+     sizeof(x) == 8 ? __builtin_bswap64((uint64_t) (x)) : (uint64_t) (x)))
+
+static inline float json_load_float(const void *p, bool swap)
+{
+    uint32_t u;
+    float v;
+
+    __builtin_memcpy(&u, p, sizeof(u));
+    if (swap) {
+        u = __builtin_bswap32(u);
+    }
+    __builtin_memcpy(&v, &u, sizeof(v));
+
+    return v;
+}
+
+static inline double json_load_double(const void *p, bool swap)
+{
+    uint64_t u;
+    double v;
+
+    __builtin_memcpy(&u, p, sizeof(u));
+    if (swap) {
+        u = __builtin_bswap64(u);
+    }
+    __builtin_memcpy(&v, &u, sizeof(v));
+
+    return v;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define JSON_LOAD_LE(x) (x)
+#define JSON_LOAD_BE(x) JSON_BSWAP(x)
+#define JSON_LOAD_LE_FLOAT(p) json_load_float(p, false)
+#define JSON_LOAD_BE_FLOAT(p) json_load_float(p, true)
+#define JSON_LOAD_LE_DOUBLE(p) json_load_double(p, false)
+#define JSON_LOAD_BE_DOUBLE(p) json_load_double(p, true)
+#define JSON_PRINT_INT_ARRAY_LE json_print_int_array
+#define JSON_PRINT_INT_ARRAY_BE json_print_int_array_bswap
+#else
+#define JSON_LOAD_LE(x) JSON_BSWAP(x)
+#define JSON_LOAD_BE(x) (x)
+#define JSON_LOAD_LE_FLOAT(p) json_load_float(p, true)
+#define JSON_LOAD_BE_FLOAT(p) json_load_float(p, false)
+#define JSON_LOAD_LE_DOUBLE(p) json_load_double(p, true)
+#define JSON_LOAD_BE_DOUBLE(p) json_load_double(p, false)
+#define JSON_PRINT_INT_ARRAY_LE json_print_int_array_bswap
+#define JSON_PRINT_INT_ARRAY_BE json_print_int_array
+#endif
 
 #endif